@@ -1,7 +1,8 @@
 /** ***************************************************************************
  * @file
  *
- * @brief contains functions that open and close image files.
+ * @brief contains functions that open and close image files and parse the
+ *        text of P3 images.
  *****************************************************************************/
 #include "netPBM.h"
 
@@ -65,4 +66,99 @@ void closeFile(ifstream& fin, ofstream& fout)
 {
     fin.close();
     fout.close();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Parses up to count white space separated decimal samples out of the text
+ * of a P3 image. Samples of 1 to 3 digits are parsed without a loop. Like
+ * reading them with >> into an int, a sample may have a sign and only its
+ * low 8 bits are kept. Parsing stops early at the end of the text or at
+ * anything that is not a number, and pos is left there.
+ *
+ * @param[in,out] pos - where to start parsing, moved past what was parsed
+ * @param[in]     end - one past the last character that may be read
+ * @param[out]    dest - where the samples go
+ * @param[in]     count - most samples to parse
+ *
+ * @returns the number of samples parsed
+ *
+ * @par Example
+ * @verbatim
+   // got = parseSamples(pos, end, row, 3 * img.cols);
+   @endverbatim
+ *****************************************************************************/
+int parseSamples(const char*& pos, const char* end, pixel* dest, int count)
+{
+    int n;
+    int length;
+    bool negative;
+    unsigned int value;
+    unsigned int d0;
+    unsigned int d1;
+    unsigned int d2;
+    const char* p = pos;
+
+    for (n = 0; n < count; n++)
+    {
+        // Skip the white space before the sample.
+        while ((p < end) && ((*p == ' ') || ((*p >= '\t') && (*p <= '\r'))))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            break;
+        }
+
+        negative = false;
+        if ((*p == '-') || (*p == '+'))
+        {
+            negative = (*p == '-');
+            p++;
+        }
+
+        if (end - p >= 4)
+        {
+            // Find the number of digits, up to 3, and combine them without
+            // branching on the length.
+            d0 = (unsigned int) (unsigned char) p[0] - '0';
+            d1 = (unsigned int) (unsigned char) p[1] - '0';
+            d2 = (unsigned int) (unsigned char) p[2] - '0';
+            length = (d0 <= 9);
+            length += (length == 1) & (d1 <= 9);
+            length += (length == 2) & (d2 <= 9);
+            if (length == 0)
+            {
+                break;
+            }
+            value = (length == 1) ? d0 :
+                (length == 2) ? d0 * 10 + d1 : d0 * 100 + d1 * 10 + d2;
+            p += length;
+        }
+        else
+        {
+            if ((p == end) || ((unsigned int) (unsigned char) *p - '0' > 9))
+            {
+                break;
+            }
+            value = 0;
+        }
+
+        // Longer samples and those near the end of the text finish here.
+        while ((p < end) && ((unsigned int) (unsigned char) *p - '0' <= 9))
+        {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+
+        dest[n] = (pixel) (negative ? 0u - value : value);
+    }
+
+    pos = p;
+    return n;
 }
\ No newline at end of file
@@ -87,45 +87,76 @@ void negate(image& img)
  * @par Description
  * Converts the image to grayscale. It multiplies the red pixel by .3, the 
  * green by .6, and blue by .1, then add them all together to get the gray
- * pixel value.
+ * pixel value. Normally this is done in fixed point as (3r + 6g + b) / 10
+ * rounded down, a row at a time so the compiler can vectorise it. The exact
+ * mode uses the double precision math of older versions, which sometimes
+ * gives one less, so their output can be matched bit for bit.
  * This function also finds the min and scale of the gray values to use for 
  * the contrast function.
  *
  * @param[in,out] img - an image structure that holds the images data
  * @param[in,out] min - smallest gray pixel value
  * @param[in,out] scale - 255 - (max gray value - min gray value)
+ * @param[in]     exact - true to use the double precision math
  *
  * @par Example
  * @verbatim
-   // grayscale(img, min, scale);
+   // grayscale(img, min, scale, false);
    @endverbatim
  *****************************************************************************/
-void grayscale(image& img, double& min, double& scale)
+void grayscale(image& img, double& min, double& scale, bool exact)
 {
     int i;
     int j;
     double max;
+    pixel* red;
+    pixel* green;
+    pixel* blue;
 
-    min = (.3 * img.redgray[0][0]) + (.6 * img.green[0][0]) 
-        + (.1 * img.blue[0][0]);
-    max = (.3 * img.redgray[0][0]) + (.6 * img.green[0][0]) 
-        + (.1 * img.blue[0][0]);
+    if (exact)
+    {
+        min = (.3 * img.redgray[0][0]) + (.6 * img.green[0][0]) 
+            + (.1 * img.blue[0][0]);
+    }
+    else
+    {
+        min = ((3u * img.redgray[0][0] + 6u * img.green[0][0]
+            + img.blue[0][0]) * GRAY_RECIPROCAL) >> 16;
+    }
+    max = min;
 
     // Calculate gray values for each pixel and find min and max value.
     for (i = 0; i < img.rows; i++)
     {
-        for (j = 0; j < img.cols; j++)
+        red = img.redgray[i];
+        green = img.green[i];
+        blue = img.blue[i];
+        if (exact)
+        {
+            for (j = 0; j < img.cols; j++)
+            {
+                red[j] = (pixel)((.3 * red[j]) + (.6 * green[j])
+                    + (.1 * blue[j]));
+            }
+        }
+        else
         {
-            img.redgray[i][j] = (pixel)((.3 * img.redgray[i][j])
-                + (.6 * img.green[i][j]) + (.1 * img.blue[i][j]));
+            for (j = 0; j < img.cols; j++)
+            {
+                red[j] = (pixel)(((3u * red[j] + 6u * green[j] + blue[j])
+                    * GRAY_RECIPROCAL) >> 16);
+            }
+        }
 
-            if (img.redgray[i][j] < min)
+        for (j = 0; j < img.cols; j++)
+        {
+            if (red[j] < min)
             {
-                min = img.redgray[i][j];
+                min = red[j];
             }
-            if (img.redgray[i][j] > max)
+            if (red[j] > max)
             {
-                max = img.redgray[i][j];
+                max = red[j];
             }
         }
     }
@@ -139,7 +170,9 @@ void grayscale(image& img, double& min, double& scale)
  *
  * @par Description
  * Find the contrast of the input image. It subtracts the min value from the 
- * gray pixel and the multiplies it by the scale.
+ * gray pixel and the multiplies it by the scale. Every gray pixel is between
+ * the min and the max, so the new value for each of those is worked out once
+ * into a 256 entry table and then looked up for each pixel.
  *
  * @param[in,out] img - an image structure that holds the images data
  * @param[in]     min - smallest gray pixel value
@@ -154,13 +187,27 @@ void contrast(image& img, double min, double scale)
 {
     int i;
     int j;
+    int v;
+    pixel* row;
+    pixel lut[256];
 
-    // Calculate contrast value of each pixel
+    // Build the table, values outside of min to max never show up.
+    for (v = 0; v < 256; v++)
+    {
+        lut[v] = 0;
+        if ((v > min) && (scale * (v - min) < 256))
+        {
+            lut[v] = (pixel)(scale * (v - min));
+        }
+    }
+
+    // Look up the contrast value of each pixel
     for (i = 0; i < img.rows; i++)
     {
+        row = img.redgray[i];
         for (j = 0; j < img.cols; j++)
         {
-            img.redgray[i][j] = (pixel)(scale * ( img.redgray[i][j] - min ));
+            row[j] = lut[row[j]];
         }
     }
 }
@@ -171,9 +218,10 @@ void contrast(image& img, double min, double scale)
  * @author Aidan Justice
  *
  * @par Description
- * Sharpens the inputted image. First it creates temporary arrays for the new
+ * Sharpens the inputted image. First it gets scratch arrays for the new
  * color values. It uses sharpenCompute to compute each new color value.
- * Finally, it puts the values of the new arrays in the old arrays.
+ * Finally, it swaps the new arrays into the image and gives the old arrays
+ * back to be reused as scratch space.
  *
  * @param[in,out] img - an image structure that holds the images data    
  *
@@ -190,10 +238,10 @@ void sharpen(image& img)
     pixel** tempgreen;
     pixel** tempblue;
     
-    // Create temporary arrays.
-    createArray(tempred, img.rows, img.cols);
-    createArray(tempgreen, img.rows, img.cols);
-    createArray(tempblue, img.rows, img.cols);
+    // Get scratch arrays to hold the new values.
+    getScratchArray(tempred, img.rows, img.cols);
+    getScratchArray(tempgreen, img.rows, img.cols);
+    getScratchArray(tempblue, img.rows, img.cols);
 
     for (i = 0; i < img.rows; i++)
     {
@@ -215,16 +263,13 @@ void sharpen(image& img)
             }
         }
     }
-    // Set original arrays to temporary arrays.
-    for (i = 0; i < img.rows; i++)
-    {
-        for (j = 0; j < img.cols; j++)
-        {
-            img.redgray[i][j] = tempred[i][j];
-            img.green[i][j] = tempgreen[i][j];
-            img.blue[i][j] = tempblue[i][j];
-        }
-    }
+    // Swap in the new arrays and give the old ones back as scratch space.
+    swap(img.redgray, tempred);
+    swap(img.green, tempgreen);
+    swap(img.blue, tempblue);
+    returnScratchArray(tempred, img.rows, img.cols);
+    returnScratchArray(tempgreen, img.rows, img.cols);
+    returnScratchArray(tempblue, img.rows, img.cols);
 }
 
 
@@ -262,10 +307,10 @@ void sharpenCompute(pixel** img, pixel** arr, int i, int j)
  * @author Aidan Justice
  *
  * @par Description
- * Smooths the inputted image. First it creates temporary arrays for each 
+ * Smooths the inputted image. First it gets scratch arrays for each 
  * color value. Uses the smoothCompute function to find new values for each 
- * pixel and stores them in the temporary arrays. Finally, it stores the new
- * values in the original arrays.
+ * pixel and stores them in the scratch arrays. Finally, it swaps the new
+ * arrays into the image and gives the old arrays back to be reused.
  *
  * @param[in,out] img - an image structure that holds the images data
  *
@@ -282,10 +327,10 @@ void smooth(image& img)
     pixel** tempgreen;
     pixel** tempblue;
 
-    // Create temporary arrays
-    createArray(tempred, img.rows, img.cols);
-    createArray(tempgreen, img.rows, img.cols);
-    createArray(tempblue, img.rows, img.cols);
+    // Get scratch arrays to hold the new values.
+    getScratchArray(tempred, img.rows, img.cols);
+    getScratchArray(tempgreen, img.rows, img.cols);
+    getScratchArray(tempblue, img.rows, img.cols);
 
     for (i = 0; i < img.rows; i++)
     {
@@ -307,16 +352,13 @@ void smooth(image& img)
             }
         }
     }
-    // Set original arrays to temporary arrays.
-    for (i = 0; i < img.rows; i++)
-    {
-        for (j = 0; j < img.cols; j++)
-        {
-            img.redgray[i][j] = tempred[i][j];
-            img.green[i][j] = tempgreen[i][j];
-            img.blue[i][j] = tempblue[i][j];
-        }
-    }
+    // Swap in the new arrays and give the old ones back as scratch space.
+    swap(img.redgray, tempred);
+    swap(img.green, tempgreen);
+    swap(img.blue, tempblue);
+    returnScratchArray(tempred, img.rows, img.cols);
+    returnScratchArray(tempgreen, img.rows, img.cols);
+    returnScratchArray(tempblue, img.rows, img.cols);
 }
 
 
@@ -5,11 +5,24 @@
  *****************************************************************************/
 #include "netPBM.h"
 
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <cstdlib>
+#endif
+
+/**
+ * @brief Arrays that were given back and are waiting to be reused.
+ */
+static vector<scratchArray> scratch;
+
 /** ***************************************************************************
  * @author Aidan Justice
  * 
  * @par Description 
- * Dynamically allocates a 2d array.
+ * Dynamically allocates a 2d array. The pixels are kept in one block with
+ * each row padded out to rowStride( cols ) pixels, so every row starts on a
+ * ROW_ALIGN boundary.
  * 
  * @param[in,out] array - the 2d array being allocated.
  * @param[in]     rows - amount of rows in the array.
@@ -25,7 +38,8 @@
 bool createArray(pixel** &array, int rows, int cols)
 {
     int i;
-    int j;
+    int stride;
+    void* block = nullptr;
     array = nullptr;
 
     // Create array and check if it allocates.
@@ -35,21 +49,32 @@ bool createArray(pixel** &array, int rows, int cols)
         cout << "Memory Allocation Error";
         return false;
     }
+    if (rows == 0)
+    {
+        return true;
+    }
+
+    // Create one aligned block for all of the rows and check if it is valid.
+    stride = rowStride(cols);
+#ifdef _WIN32
+    block = _aligned_malloc((size_t)rows * stride, ROW_ALIGN);
+#else
+    if (posix_memalign(&block, ROW_ALIGN, (size_t)rows * stride) != 0)
+    {
+        block = nullptr;
+    }
+#endif
+    if (block == nullptr)
+    {
+        delete[] array;
+        cout << "Memory Allocation Error";
+        return false;
+    }
 
-    // Create column arrays and check if they are valid.
+    // Point each row into the block.
     for (i = 0; i < rows; i++)
     {
-        array[i] = new (nothrow) pixel[cols];
-        if (array[i] == nullptr)
-        {
-            for (j = 0; j < i; j++)
-            {
-                delete[] array[j];
-            }
-            delete[] array;
-            cout << "Memory Allocation Error";
-            return false;
-        }
+        array[i] = (pixel*)block + (size_t)i * stride;
     }
     return true;
 }
@@ -60,7 +85,7 @@ bool createArray(pixel** &array, int rows, int cols)
  * @author Aidan Justice
  *
  * @par Description
- * Deletes the inputted 2d array.
+ * Deletes the inputted 2d array that was made by createArray.
  *
  * @param[in,out] array - 2d array to be deleted.
  * @param[in]     rows - amount of rows in the array.
@@ -72,14 +97,133 @@ bool createArray(pixel** &array, int rows, int cols)
  *****************************************************************************/
 void clearArray(pixel** &array, int rows)
 {
-    int i;
-    
-    // Clear column arrays.
-    for (i = 0; i < rows; i++)
+    // Clear the block holding the rows, which starts at the first row.
+    if (rows > 0)
     {
-        delete[] array[i];
+#ifdef _WIN32
+        _aligned_free(array[0]);
+#else
+        free(array[0]);
+#endif
     }
 
     // Clear main array.
     delete[] array;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Finds the distance between the start of two rows in an array made by
+ * createArray. It is the column count padded up to a multiple of ROW_ALIGN,
+ * so loops may safely run over the padding to the next vector width.
+ *
+ * @param[in]     cols - amount of columns in the array.
+ *
+ * @returns the padded row length in pixels.
+ *
+ * @par Example
+ * @verbatim
+   // stride = rowStride( img.cols );
+   @endverbatim
+ *****************************************************************************/
+int rowStride(int cols)
+{
+    return ((cols + ROW_ALIGN - 1) / ROW_ALIGN) * ROW_ALIGN;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Hands out a 2d array to use as scratch space. An array of the same size
+ * that was given back earlier is reused if there is one, otherwise a new one
+ * is created.
+ *
+ * @param[in,out] array - set to the scratch array.
+ * @param[in]     rows - amount of rows in the array.
+ * @param[in]     cols - amount of columns in the array.
+ *
+ * @returns true if an array was handed out, false if it failed
+ *
+ * @par Example
+ * @verbatim
+   // getScratchArray( tempred, img.rows, img.cols );
+   @endverbatim
+ *****************************************************************************/
+bool getScratchArray(pixel** &array, int rows, int cols)
+{
+    size_t i;
+
+    // Look for a given back array of the same size.
+    for (i = 0; i < scratch.size(); i++)
+    {
+        if ((scratch[i].rows == rows) && (scratch[i].cols == cols))
+        {
+            array = scratch[i].array;
+            scratch[i] = scratch.back();
+            scratch.pop_back();
+            return true;
+        }
+    }
+
+    return createArray(array, rows, cols);
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gives a 2d array back so it can be handed out again as scratch space.
+ *
+ * @param[in,out] array - the array to give back, set to nullptr.
+ * @param[in]     rows - amount of rows in the array.
+ * @param[in]     cols - amount of columns in the array.
+ *
+ * @par Example
+ * @verbatim
+   // returnScratchArray( tempred, img.rows, img.cols );
+   @endverbatim
+ *****************************************************************************/
+void returnScratchArray(pixel** &array, int rows, int cols)
+{
+    scratchArray entry;
+
+    entry.array = array;
+    entry.rows = rows;
+    entry.cols = cols;
+    scratch.push_back(entry);
+
+    array = nullptr;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Deletes every array that was given back as scratch space.
+ *
+ * @par Example
+ * @verbatim
+   // clearScratchArrays();
+   @endverbatim
+ *****************************************************************************/
+void clearScratchArrays()
+{
+    size_t i;
+
+    for (i = 0; i < scratch.size(); i++)
+    {
+        clearArray(scratch[i].array, scratch[i].rows);
+    }
+    scratch.clear();
 }
\ No newline at end of file
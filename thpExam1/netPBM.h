@@ -6,6 +6,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstring>
 
 using namespace std;
 #ifndef __NETPBM__H__
@@ -16,6 +18,29 @@ using namespace std;
 */
 typedef unsigned char pixel;
 
+/**
+ * @brief Rows of a pixel array start on a multiple of this many bytes.
+*/
+const int ROW_ALIGN = 64;
+
+/**
+ * @brief Number of bytes read from the file at a time when reading a binary
+ *        image.
+*/
+const int READ_BLOCK_SIZE = 1024 * 1024;
+
+/**
+ * @brief Number of bytes gathered before each write to the file when writing
+ *        a binary image.
+*/
+const int WRITE_BLOCK_SIZE = 1024 * 1024;
+
+/**
+ * @brief Fixed point reciprocal of 10. For every n up to 2550, the largest
+ *        3r + 6g + b can be, (n * GRAY_RECIPROCAL) >> 16 equals n / 10.
+*/
+const unsigned int GRAY_RECIPROCAL = 6554;
+
 /**
  * @brief Holds the data stored in the original image file. 
 */
@@ -30,14 +55,29 @@ struct image
     pixel **blue; /**< Holds the blue pixel values for the image. */
 };
 
+/**
+ * @brief A 2d array that was given back to be reused as scratch space.
+*/
+struct scratchArray
+{
+    pixel **array; /**< The 2d array. */
+    int rows; /**< The amount of rows in the array. */
+    int cols; /**< The amount of columns in the array. */
+};
+
 void outputErrorMessage();
 bool openFile(ifstream& fin, string input, ofstream& fout, string output);
 void closeFile(ifstream& fin, ofstream& fout);
 bool createArray(pixel** &array, int rows, int cols);
+int rowStride(int cols);
 void clearArray(pixel** &array, int rows);
+bool getScratchArray(pixel** &array, int rows, int cols);
+void returnScratchArray(pixel** &array, int rows, int cols);
+void clearScratchArrays();
 void readHeader(image& img, ifstream& fin);
 void outputHeader(image img, ofstream& fout);
 void readAscii(ifstream& fin, image& img);
+int parseSamples(const char*& pos, const char* end, pixel* dest, int count);
 void readBinary(ifstream& fin, image& img);
 void outputAscii(ofstream& fout, image img);
 void outputBinary(ofstream& fout, image img);
@@ -46,7 +86,7 @@ void outputGrayBinary(image img, ofstream& fout);
 void brighten(image& img, int value);
 void checkNum(int& num);
 void negate(image& img);
-void grayscale(image& img, double& min, double& scale);
+void grayscale(image& img, double& min, double& scale, bool exact);
 void contrast(image& img, double min, double scale);
 void sharpen(image& img);
 void sharpenCompute(pixel** img, pixel** arr, int i, int j);
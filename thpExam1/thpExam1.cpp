@@ -39,7 +39,8 @@
   * combines them to a single grayscale pixel. Finally, you can contrast an
   * image which grayscales the image and subtracts the minimum value from each
   * pixel and then multiplies it by the scale. The last two options convert
-  * image to a .pgm file.
+  * image to a .pgm file. Their -gx and -cx versions compute the gray values
+  * in double precision like older versions did, instead of in fixed point.
   *
   * @section compile_section Compiling and Usage
   *
@@ -56,6 +57,8 @@
               -s            Smooth
               -g            Grayscale
               -c            Contrast
+              -gx           Grayscale, exact
+              -cx           Contrast, exact
             -oa - Convert image to ascii format
             -ob - Convert image to binary format
             basename  - output image name
@@ -104,6 +107,7 @@ int main(int argc, char** argv)
     image img;
     double min;
     double scale;
+    bool exact;
     
     //Check for valid number of command line args
     if ((argc < 4) || (argc > 6))
@@ -129,7 +133,8 @@ int main(int argc, char** argv)
     {
         if (!( (strcmp(argv[1], "-n") == 0) || (strcmp(argv[1], "-p") == 0)
             || (strcmp(argv[1], "-s") == 0) || (strcmp(argv[1], "-g") == 0)
-            || (strcmp(argv[1], "-c") == 0) || (strcmp(argv[1], "-b") == 0) &&
+            || (strcmp(argv[1], "-c") == 0) || (strcmp(argv[1], "-gx") == 0)
+            || (strcmp(argv[1], "-cx") == 0) || (strcmp(argv[1], "-b") == 0) &&
             !((strcmp(argv[2], "-oa") == 0) || (strcmp(argv[2], "-ob") == 0))))
         {
             outputErrorMessage();
@@ -162,6 +167,15 @@ int main(int argc, char** argv)
     }
 
 
+    // The x versions of grayscale and contrast use the exact gray values.
+    exact = false;
+    if ((option == "-gx") || (option == "-cx"))
+    {
+        exact = true;
+        option.erase(2);
+    }
+
+
     // Add the file extension to the basename.
     if ((option == "-g") || (option == "-c"))
     {
@@ -254,7 +268,7 @@ int main(int argc, char** argv)
     }
     else if ((option == "-g") || (option == "-c"))
     {
-        grayscale(img, min, scale);
+        grayscale(img, min, scale, exact);
         if (option == "-c")
         {
             contrast(img, min, scale);
@@ -302,6 +316,7 @@ int main(int argc, char** argv)
     clearArray(img.redgray, img.rows);
     clearArray(img.green, img.rows);
     clearArray(img.blue, img.rows);
+    clearScratchArrays();
     closeFile(fin, fout);
 
     return 0;
@@ -327,6 +342,7 @@ void outputErrorMessage()
     cout << "-b # Brighten" << endl << "-p   Sharpen" << endl;
     cout << "-s   Smooth" << endl << "-g   Grayscale" << endl;
     cout << "-c   Contrast" << endl;
+    cout << "-gx  Grayscale, exact" << endl << "-cx  Contrast, exact" << endl;
 }
 
 
@@ -392,7 +408,8 @@ void outputHeader(image img, ofstream& fout)
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P3 .ppm image.
+ * Read in the data from a P3 .ppm image. The rest of the file is read into
+ * memory in large blocks and the samples are parsed with parseSamples.
  *
  * @param[in,out] fin - inputted image file 
  * @param[in,out] img - image structure that holds the images data
@@ -404,23 +421,44 @@ void outputHeader(image img, ofstream& fout)
  *****************************************************************************/
 void readAscii(ifstream& fin, image& img)
 {
-    int i; 
+    int i;
     int j;
-    int temp_value;
-
-    // Read ascii values into the image arrays.
+    int got;
+    size_t size;
+    size_t rowSize;
+    const char* pos;
+    const char* end;
+    vector<char> text;
+    vector<pixel> row;
+
+    // Read the rest of the file in blocks.
+    size = 0;
+    do
+    {
+        text.resize(size + READ_BLOCK_SIZE);
+        fin.read(text.data() + size, READ_BLOCK_SIZE);
+        size += (size_t) fin.gcount();
+    } while (fin);
+    fin.clear();
+
+    // Parse a row at a time, setting anything missing to 0.
+    pos = text.data();
+    end = pos + size;
+    rowSize = 3 * (size_t) img.cols;
+    row.resize(rowSize);
     for (i = 0; i < img.rows; i++)
     {
-        for (j = 0; j < img.cols; j++)
+        got = parseSamples(pos, end, row.data(), (int) rowSize);
+        for (j = got; j < (int) rowSize; j++)
         {
-            fin >> temp_value;
-            img.redgray[i][j] = temp_value;
-
-            fin >> temp_value;
-            img.green[i][j] = temp_value;
+            row[j] = 0;
+        }
 
-            fin >> temp_value;
-            img.blue[i][j] = temp_value;
+        for (j = 0; j < img.cols; j++)
+        {
+            img.redgray[i][j] = row[3 * j];
+            img.green[i][j] = row[3 * j + 1];
+            img.blue[i][j] = row[3 * j + 2];
         }
     }
 }
@@ -431,7 +469,10 @@ void readAscii(ifstream& fin, image& img)
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P6 .ppm image.
+ * Read in the data from a P6 .ppm image. The data is read in blocks of
+ * whole rows, about READ_BLOCK_SIZE bytes at a time, and each row is split
+ * into the color arrays. If the file ends early, the pixels it is missing
+ * are set to 0.
  *
  * @param[in,out] fin - inputted image file
  * @param[in,out] img - image structure that holds the images data
@@ -445,17 +486,58 @@ void readBinary(ifstream& fin, image& img)
 {
     int i;
     int j;
+    int k;
+    int blockRows;
+    size_t rowBytes;
+    pixel* buffer;
+    pixel* row;
 
-    // Read binary values into the image arrays.
-    for (i = 0; i < img.rows; i++)
+    if ((img.rows == 0) || (img.cols == 0))
     {
-        for (j = 0; j < img.cols; j++)
+        return;
+    }
+
+    // Read as many whole rows at a time as fit in a block.
+    rowBytes = 3 * (size_t) img.cols;
+    blockRows = (int) (READ_BLOCK_SIZE / rowBytes);
+    if (blockRows < 1)
+    {
+        blockRows = 1;
+    }
+    if (blockRows > img.rows)
+    {
+        blockRows = img.rows;
+    }
+    buffer = new (nothrow) pixel[rowBytes * blockRows];
+    if (buffer == nullptr)
+    {
+        cout << "Memory Allocation Error";
+        return;
+    }
+
+    for (i = 0; i < img.rows; i += blockRows)
+    {
+        if (i + blockRows > img.rows)
         {
-            fin.read((char*)&img.redgray[i][j], sizeof(pixel));
-            fin.read((char*)&img.green[i][j], sizeof(pixel));
-            fin.read((char*)&img.blue[i][j], sizeof(pixel));
+            blockRows = img.rows - i;
+        }
+        fin.read((char*) buffer, rowBytes * blockRows);
+        memset(buffer + fin.gcount(), 0, rowBytes * blockRows - fin.gcount());
+
+        // Split each row of the block into the color arrays.
+        for (k = 0; k < blockRows; k++)
+        {
+            row = buffer + k * rowBytes;
+            for (j = 0; j < img.cols; j++)
+            {
+                img.redgray[i + k][j] = row[3 * j];
+                img.green[i + k][j] = row[3 * j + 1];
+                img.blue[i + k][j] = row[3 * j + 2];
+            }
         }
     }
+
+    delete[] buffer;
 }
 
 
@@ -497,7 +579,8 @@ void outputAscii(ofstream& fout, image img)
  * @author Aidan Justice
  *
  * @par Description
- * Output the binary data to the new image file.
+ * Output the binary data to the new image file. Rows are interleaved into a
+ * buffer that is written about WRITE_BLOCK_SIZE bytes at a time.
  *
  * @param[in,out] fout - output image file
  * @param[in]     img - image structure that holds the images data
@@ -511,17 +594,57 @@ void outputBinary(ofstream& fout, image img)
 {
     int i;
     int j;
+    int k;
+    int blockRows;
+    size_t rowBytes;
+    pixel* buffer;
+    pixel* row;
 
-    // Write each color value to file in binary.
-    for (i = 0; i < img.rows; i++)
+    if ((img.rows == 0) || (img.cols == 0))
     {
-        for (j = 0; j < img.cols; j++)
+        return;
+    }
+
+    // Gather as many whole rows at a time as fit in a block.
+    rowBytes = 3 * (size_t) img.cols;
+    blockRows = (int) (WRITE_BLOCK_SIZE / rowBytes);
+    if (blockRows < 1)
+    {
+        blockRows = 1;
+    }
+    if (blockRows > img.rows)
+    {
+        blockRows = img.rows;
+    }
+    buffer = new (nothrow) pixel[rowBytes * blockRows];
+    if (buffer == nullptr)
+    {
+        cout << "Memory Allocation Error";
+        return;
+    }
+
+    for (i = 0; i < img.rows; i += blockRows)
+    {
+        if (i + blockRows > img.rows)
+        {
+            blockRows = img.rows - i;
+        }
+
+        // Interleave each row of the block.
+        for (k = 0; k < blockRows; k++)
         {
-            fout.write((char*)&img.redgray[i][j], sizeof(pixel));
-            fout.write((char*)&img.green[i][j], sizeof(pixel));
-            fout.write((char*)&img.blue[i][j], sizeof(pixel));
+            row = buffer + k * rowBytes;
+            for (j = 0; j < img.cols; j++)
+            {
+                row[3 * j] = img.redgray[i + k][j];
+                row[3 * j + 1] = img.green[i + k][j];
+                row[3 * j + 2] = img.blue[i + k][j];
+            }
         }
+        fout.write((char*) buffer, rowBytes * blockRows);
     }
+
+    delete[] buffer;
 }
 
 
@@ -590,7 +713,8 @@ void outputGrayAscii(image img, ofstream& fout)
  * @author Aidan Justice
  *
  * @par Description
- * Output the binary grayscale data to a new image file.
+ * Output the binary grayscale data to a new image file. Rows are gathered
+ * into a buffer that is written about WRITE_BLOCK_SIZE bytes at a time.
  *
  * @param[in]     img - image structure that holds the images data
  * @param[in,out] fout - output image file
@@ -603,14 +727,46 @@ void outputGrayAscii(image img, ofstream& fout)
 void outputGrayBinary(image img, ofstream& fout)
 {
     int i;
-    int j;
+    int k;
+    int blockRows;
+    pixel* buffer;
 
-    // Write one gray pixel at a time in binary.
-    for (i = 0; i < img.rows; i++)
+    if ((img.rows == 0) || (img.cols == 0))
     {
-        for (j = 0; j < img.cols; j++)
+        return;
+    }
+
+    // Gather as many whole rows at a time as fit in a block.
+    blockRows = WRITE_BLOCK_SIZE / img.cols;
+    if (blockRows < 1)
+    {
+        blockRows = 1;
+    }
+    if (blockRows > img.rows)
+    {
+        blockRows = img.rows;
+    }
+    buffer = new (nothrow) pixel[(size_t)img.cols * blockRows];
+    if (buffer == nullptr)
+    {
+        cout << "Memory Allocation Error";
+        return;
+    }
+
+    for (i = 0; i < img.rows; i += blockRows)
+    {
+        if (i + blockRows > img.rows)
         {
-            fout.write((char*)&img.redgray[i][j], sizeof(pixel));
+            blockRows = img.rows - i;
         }
+
+        // Copy each row of the block, leaving out the padding.
+        for (k = 0; k < blockRows; k++)
+        {
+            memcpy(buffer + (size_t)k * img.cols, img.redgray[i + k], img.cols);
+        }
+        fout.write((char*)buffer, (size_t)img.cols * blockRows);
     }
+
+    delete[] buffer;
 }
\ No newline at end of file
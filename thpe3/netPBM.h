@@ -6,6 +6,17 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 )
+#include <emmintrin.h>
+/**
+ * @brief Defined when the fill can compare 16 pixels at a time with SSE2.
+*/
+#define FILL_SSE2
+#endif
 
 using namespace std;
 #ifndef __NETPBM__H__
@@ -27,6 +38,20 @@ enum color { RED, /**<Access red color value.*/
             };
 
 
+/**
+ * @brief Number of bytes read from the file at a time when reading a binary
+ *        image.
+*/
+const int READ_BLOCK_SIZE = 1024 * 1024;
+
+
+/**
+ * @brief Number of bytes gathered before each write to the file when writing
+ *        a binary image.
+*/
+const int WRITE_BLOCK_SIZE = 1024 * 1024;
+
+
 /**
  * @brief Holds the data stored in the original image file. 
 */
@@ -42,6 +67,18 @@ struct image
 };
 
 
+/**
+ * @brief A run of pixels along a row that fill has filled and whose
+ *        neighbors above and below still need to be looked at.
+*/
+struct fillSpan
+{
+    int row; /**< Row the run is on. */
+    int left; /**< First column of the run. */
+    int right; /**< One past the last column of the run. */
+};
+
+
 /*******************************************************************************
  *                         Function Prototypes
  ******************************************************************************/
@@ -52,10 +89,15 @@ void clearArray( pixel** &array, int rows );
 void readHeader( image& img, fstream& fin );
 void outputHeader( image img, fstream& fout );
 void readAscii( fstream& fin, image& img );
+int parseSamples( const char*& pos, const char* end, pixel* dest, int count );
 void readBinary( fstream& fin, image& img );
 void outputAscii( fstream& fout, image img );
 void outputBinary( fstream& fout, image img );
-void fill( image& img, int row, int col, int newColor[], int oldColor[] );
+void fill( image& img, int row, int col, int newColor[], int oldColor[],
+    int connect = 4 );
+void fillRun( image& img, fillSpan run, int newColor[] );
+int scanLeft( image& img, int row, int col, int color[] );
+int scanRight( image& img, int row, int col, int end, int color[], bool same );
 bool getStartColor( image img, int oldColor[], int row, int col );
 bool operator>>( fstream& file, image& img );
 
@@ -26,28 +26,27 @@
   * @details
   * This program is designed to flood fill a region of an ppm image. 
   * Using the user's given starting point and color values, the program 
-  * recursively fills the region that it started in. It fills a pixel and 
-  * moves to an adjacent one until it finds either the same color, a different
-  * color, or the edge. After it finds that base case, it will try the next 
-  * adjacent pixel and will keep going until it returns back to the starting
-  * pixel.
+  * fills the region that it started in. It fills whole runs of pixels along
+  * a row at a time and keeps the runs still to be looked at on a stack in
+  * heap memory, so even regions of tens of millions of pixels only need a
+  * little of the program's stack. Pixels can join the region through their
+  * 4 sides or through their sides and corners, 8 connectivity.
   *
   * @section compile_section Compiling and Usage
   *
   * @par Compiling Instructions:
-  *      Must change the Stack Reserve Size and Stack Commit Size to 
-  * 4 billion (4000000000). This can be found by right clicking the project
-  * name, selecting Properties, expanding the Linker options, and going to 
-  * System. 
+  *      none - a straight compile and link with no external libraries. The
+  * default stack size is enough, the fill does not recurse.
   *
   * @par Usage:
     @verbatim
-    c:\> thpe3.exe imageFile row col redValue greenValue blueValue
+    c:\> thpe3.exe imageFile row col redValue greenValue blueValue [4|8]
              imageFile - image to be edited
              row, col - starting pixel value to fill
              redValue - red value to fill area with
              greenValue - green value to fill area with
              blueValue - blue value to fill area with
+             4 or 8 - neighbors of each pixel, 4 if not given
     @endverbatim
   *
   * @section todo_bugs_modification_section Todo, Bugs, and Modifications
@@ -72,7 +71,7 @@
  *
  * @par Example
  * @verbatim
-   // thpe3.exe imageFile row col redValue greenValue blueValue
+   // thpe3.exe imageFile row col redValue greenValue blueValue [4|8]
    @endverbatim
  *****************************************************************************/
 int main( int argc, char** argv )
@@ -83,16 +82,24 @@ int main( int argc, char** argv )
     int col;
     int newColor[3];
     int oldColor[3];
+    int connect = 4;
 
-    if ( argc != 7 )
+    if ( argc == 8 )
+    {
+        connect = atoi( argv[7] );
+    }
+
+    if ( ( ( argc != 7 ) && ( argc != 8 ) ) ||
+        ( ( connect != 4 ) && ( connect != 8 ) ) )
     {
         cout << "Usage: thpe3.exe imageFile row col redValue greenValue blueValue"
-            << endl;
+            << " [4|8]" << endl;
         cout << "imageFile  - image to be edited" << endl;
         cout << "row, col   - starting pixel value to fill" << endl;
         cout << "redValue   - red value to fill area with" << endl;
         cout << "greenValue - green value to fill area with" << endl;
         cout << "blueValue  - blue value to fill area with" << endl;
+        cout << "4 or 8     - neighbors of each pixel, 4 if not given" << endl;
         return 0;
     }
 
@@ -120,7 +127,7 @@ int main( int argc, char** argv )
         return 0;
     }
 
-    fill( img, row, col, newColor, oldColor );
+    fill( img, row, col, newColor, oldColor, connect );
 
     file.seekp( ios::beg, 0 );
     outputHeader( img, file );
@@ -208,7 +215,8 @@ void outputHeader( image img, fstream& fout )
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P3 .ppm image.
+ * Read in the data from a P3 .ppm image. The rest of the file is read into
+ * memory in large blocks and the samples are parsed with parseSamples.
  *
  * @param[in,out] fin - inputted image file
  * @param[in,out] img - image structure that holds the images data
@@ -222,21 +230,42 @@ void readAscii( fstream& fin, image& img )
 {
     int i;
     int j;
-    int temp_value;
-
-    // Read ascii values into the image arrays.
+    int got;
+    size_t size;
+    size_t rowSize;
+    const char* pos;
+    const char* end;
+    vector<char> text;
+    vector<pixel> row;
+
+    // Read the rest of the file in blocks.
+    size = 0;
+    do
+    {
+        text.resize( size + READ_BLOCK_SIZE );
+        fin.read( text.data(  ) + size, READ_BLOCK_SIZE );
+        size += ( size_t ) fin.gcount(  );
+    } while ( fin );
+    fin.clear(  );
+
+    // Parse a row at a time, setting anything missing to 0.
+    pos = text.data(  );
+    end = pos + size;
+    rowSize = 3 * ( size_t ) img.cols;
+    row.resize( rowSize );
     for ( i = 0; i < img.rows; i++ )
     {
-        for ( j = 0; j < img.cols; j++ )
+        got = parseSamples( pos, end, row.data(  ), ( int ) rowSize );
+        for ( j = got; j < ( int ) rowSize; j++ )
         {
-            fin >> temp_value;
-            img.redgray[i][j] = temp_value;
-
-            fin >> temp_value;
-            img.green[i][j] = temp_value;
+            row[j] = 0;
+        }
 
-            fin >> temp_value;
-            img.blue[i][j] = temp_value;
+        for ( j = 0; j < img.cols; j++ )
+        {
+            img.redgray[i][j] = row[3 * j];
+            img.green[i][j] = row[3 * j + 1];
+            img.blue[i][j] = row[3 * j + 2];
         }
     }
 }
@@ -246,7 +275,10 @@ void readAscii( fstream& fin, image& img )
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P6 .ppm image.
+ * Read in the data from a P6 .ppm image. The data is read in blocks of
+ * whole rows, about READ_BLOCK_SIZE bytes at a time, and each row is split
+ * into the color arrays. If the file ends early, the pixels it is missing
+ * are set to 0.
  *
  * @param[in,out] fin - inputted image file
  * @param[in,out] img - image structure that holds the images data
@@ -260,17 +292,59 @@ void readBinary( fstream& fin, image& img )
 {
     int i;
     int j;
+    int k;
+    int blockRows;
+    size_t rowBytes;
+    pixel* buffer;
+    pixel* row;
 
-    // Read binary values into the image arrays.
-    for ( i = 0; i < img.rows; i++ )
+    if ( ( img.rows == 0 ) || ( img.cols == 0 ) )
     {
-        for ( j = 0; j < img.cols; j++ )
+        return;
+    }
+
+    // Read as many whole rows at a time as fit in a block.
+    rowBytes = 3 * ( size_t ) img.cols;
+    blockRows = ( int ) ( READ_BLOCK_SIZE / rowBytes );
+    if ( blockRows < 1 )
+    {
+        blockRows = 1;
+    }
+    if ( blockRows > img.rows )
+    {
+        blockRows = img.rows;
+    }
+    buffer = new ( nothrow ) pixel[rowBytes * blockRows];
+    if ( buffer == nullptr )
+    {
+        cout << "Memory Allocation Error";
+        return;
+    }
+
+    for ( i = 0; i < img.rows; i += blockRows )
+    {
+        if ( i + blockRows > img.rows )
         {
-            fin.read( ( char* ) &img.redgray[i][j], sizeof( pixel ) );
-            fin.read( ( char* ) &img.green[i][j], sizeof( pixel ) );
-            fin.read( ( char* ) &img.blue[i][j], sizeof( pixel ) );
+            blockRows = img.rows - i;
+        }
+        fin.read( ( char* ) buffer, rowBytes * blockRows );
+        memset( buffer + fin.gcount(), 0, rowBytes * blockRows -
+            fin.gcount() );
+
+        // Split each row of the block into the color arrays.
+        for ( k = 0; k < blockRows; k++ )
+        {
+            row = buffer + k * rowBytes;
+            for ( j = 0; j < img.cols; j++ )
+            {
+                img.redgray[i + k][j] = row[3 * j];
+                img.green[i + k][j] = row[3 * j + 1];
+                img.blue[i + k][j] = row[3 * j + 2];
+            }
         }
     }
+
+    delete[] buffer;
 }
 
 
@@ -310,7 +384,8 @@ void outputAscii( fstream& fout, image img )
  * @author Aidan Justice
  *
  * @par Description
- * Output the binary data to the new image file.
+ * Output the binary data to the new image file. Rows are interleaved into a
+ * buffer that is written about WRITE_BLOCK_SIZE bytes at a time.
  *
  * @param[in,out] fout - output image file
  * @param[in]     img - image structure that holds the images data
@@ -324,64 +399,295 @@ void outputBinary( fstream& fout, image img )
 {
     int i;
     int j;
+    int k;
+    int blockRows;
+    size_t rowBytes;
+    pixel* buffer;
+    pixel* row;
 
-    // Write each color value to file in binary.
-    for ( i = 0; i < img.rows; i++ ) 
+    if ( ( img.rows == 0 ) || ( img.cols == 0 ) )
     {
-        for ( j = 0; j < img.cols; j++ )
+        return;
+    }
+
+    // Gather as many whole rows at a time as fit in a block.
+    rowBytes = 3 * ( size_t ) img.cols;
+    blockRows = ( int ) ( WRITE_BLOCK_SIZE / rowBytes );
+    if ( blockRows < 1 )
+    {
+        blockRows = 1;
+    }
+    if ( blockRows > img.rows )
+    {
+        blockRows = img.rows;
+    }
+    buffer = new ( nothrow ) pixel[rowBytes * blockRows];
+    if ( buffer == nullptr )
+    {
+        cout << "Memory Allocation Error";
+        return;
+    }
+
+    for ( i = 0; i < img.rows; i += blockRows )
+    {
+        if ( i + blockRows > img.rows )
+        {
+            blockRows = img.rows - i;
+        }
+
+        // Interleave each row of the block.
+        for ( k = 0; k < blockRows; k++ )
         {
-            fout.write( ( char* ) &img.redgray[i][j], sizeof( pixel ) );
-            fout.write( ( char* ) &img.green[i][j], sizeof( pixel ) );
-            fout.write( ( char* ) &img.blue[i][j], sizeof( pixel ) );
+            row = buffer + k * rowBytes;
+            for ( j = 0; j < img.cols; j++ )
+            {
+                row[3 * j] = img.redgray[i + k][j];
+                row[3 * j + 1] = img.green[i + k][j];
+                row[3 * j + 2] = img.blue[i + k][j];
+            }
         }
+        fout.write( ( char* ) buffer, rowBytes * blockRows );
     }
+
+    delete[] buffer;
 }
 
 /** ***************************************************************************
  * @author Aidan Justice
  *
  * @par Description
- * If the given pixel is not within the range of the image, not the original
- * color of the starting pixel, or is the new color, it changes the given
- * pixel value to the user's new color. After it changes the color, it calls
- * this function on the adjacent pixels.
+ * Fills the region of the old color that the given pixel is in with the new
+ * color. Instead of calling itself for every pixel, which runs out of stack
+ * on large regions, it fills whole runs of pixels along a row at a time and
+ * keeps the runs whose neighbors still need to be looked at on a stack
+ * allocated on the heap. For each run taken off the stack, the rows above
+ * and below it are scanned for runs of the old color, each of which is
+ * filled and pushed. With 4 connectivity pixels only join the region
+ * through their sides, with 8 connectivity through their corners as well,
+ * so the scan reaches one pixel past each end of the run. Nothing is done
+ * if the pixel is outside the image, not the old color, or if the old color
+ * is already the new color.
  *
  * @param[in,out] img - image structure that holds all the image's data
- * @param[in] row - row of the pixel to change
- * @param[in] col - column of the pixel to change
+ * @param[in] row - row of the pixel to start from
+ * @param[in] col - column of the pixel to start from
  * @param[in] newColor - array that holds the 3 new color values
  * @param[in] oldColor - array that holds the 3 old color values
+ * @param[in] connect - 4 or 8, the number of neighbors of each pixel
  *
  * @par Example
  * @verbatim
-   // fill( img, row, col, newColor, oldColor );
+   // fill( img, row, col, newColor, oldColor, 4 );
    @endverbatim
  *****************************************************************************/
-void fill( image& img, int row, int col, int newColor[], int oldColor[] )
+void fill( image& img, int row, int col, int newColor[], int oldColor[],
+    int connect )
 {
-    // Check the base case.
-    if (( row < 0 ) || ( row >= img.rows ) || 
+    int i;
+    int j;
+    int k;
+    int end;
+    int reach;
+    fillSpan run;
+    vector<fillSpan> stack;
+
+    // Check that there is anything to fill.
+    if ( ( row < 0 ) || ( row >= img.rows ) ||
         ( col < 0 ) || ( col >= img.cols ) ||
-        ( img.redgray[row][col] != oldColor[RED] ) ||
-        ( img.green[row][col] != oldColor[GREEN] ) ||
-        ( img.blue[row][col] != oldColor[BLUE] ) ||
-        (( img.redgray[row][col] == newColor[RED] ) &&
-        ( img.green[row][col] == newColor[GREEN] ) &&
-        ( img.blue[row][col] == newColor[BLUE] ) ) )
+        ( scanRight( img, row, col, col + 1, oldColor, true ) == col ) ||
+        ( ( ( pixel ) newColor[RED] == oldColor[RED] ) &&
+        ( ( pixel ) newColor[GREEN] == oldColor[GREEN] ) &&
+        ( ( pixel ) newColor[BLUE] == oldColor[BLUE] ) ) )
     {
         return;
     }
+    reach = ( connect == 8 ) ? 1 : 0;
+
+    // Fill the run the starting pixel is in.
+    run.row = row;
+    run.left = scanLeft( img, row, col, oldColor );
+    run.right = scanRight( img, row, col, img.cols, oldColor, true );
+    fillRun( img, run, newColor );
+    stack.push_back( run );
+
+    while ( !stack.empty() )
+    {
+        run = stack.back();
+        stack.pop_back();
+
+        // Look for runs of the old color in the rows above and below.
+        for ( k = -1; k <= 1; k += 2 )
+        {
+            i = run.row + k;
+            if ( ( i < 0 ) || ( i >= img.rows ) )
+            {
+                continue;
+            }
+
+            j = max( run.left - reach, 0 );
+            end = min( run.right + reach, img.cols );
+            while ( ( j = scanRight( img, i, j, end, oldColor, false ) ) < end )
+            {
+                // Fill the whole run, even the part past the ends of this one.
+                fillSpan next;
+                next.row = i;
+                next.left = scanLeft( img, i, j, oldColor );
+                next.right = scanRight( img, i, j, img.cols, oldColor, true );
+                fillRun( img, next, newColor );
+                stack.push_back( next );
+                j = next.right;
+            }
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets a run of pixels along a row to the new color.
+ *
+ * @param[in,out] img - image structure that holds all the image's data
+ * @param[in] run - row and columns of the run
+ * @param[in] newColor - array that holds the 3 new color values
+ *
+ * @par Example
+ * @verbatim
+   // fillRun( img, run, newColor );
+   @endverbatim
+ *****************************************************************************/
+void fillRun( image& img, fillSpan run, int newColor[] )
+{
+    memset( img.redgray[run.row] + run.left, ( pixel ) newColor[RED],
+        run.right - run.left );
+    memset( img.green[run.row] + run.left, ( pixel ) newColor[GREEN],
+        run.right - run.left );
+    memset( img.blue[run.row] + run.left, ( pixel ) newColor[BLUE],
+        run.right - run.left );
+}
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Moves left from a pixel of the given color for as long as the pixels are
+ * that color. With SSE2, 16 pixels are compared at a time and the last few
+ * one at a time.
+ *
+ * @param[in] img - image structure that holds all the image's data
+ * @param[in] row - row to scan
+ * @param[in] col - column to start from, must be the given color
+ * @param[in] color - array that holds the 3 color values
+ *
+ * @returns the first column of the run of the color.
+ *
+ * @par Example
+ * @verbatim
+   // left = scanLeft( img, row, col, oldColor );
+   @endverbatim
+ *****************************************************************************/
+int scanLeft( image& img, int row, int col, int color[] )
+{
+    const pixel* red = img.redgray[row];
+    const pixel* green = img.green[row];
+    const pixel* blue = img.blue[row];
+
+#ifdef FILL_SSE2
+    __m128i r = _mm_set1_epi8( ( char ) color[RED] );
+    __m128i g = _mm_set1_epi8( ( char ) color[GREEN] );
+    __m128i b = _mm_set1_epi8( ( char ) color[BLUE] );
+    __m128i same;
+
+    // Step back 16 pixels at a time while they all match.
+    while ( col >= 16 )
+    {
+        same = _mm_and_si128( _mm_cmpeq_epi8( r, _mm_loadu_si128(
+            ( const __m128i* ) ( red + col - 16 ) ) ),
+            _mm_and_si128( _mm_cmpeq_epi8( g, _mm_loadu_si128(
+            ( const __m128i* ) ( green + col - 16 ) ) ),
+            _mm_cmpeq_epi8( b, _mm_loadu_si128(
+            ( const __m128i* ) ( blue + col - 16 ) ) ) ) );
+        if ( _mm_movemask_epi8( same ) != 0xFFFF )
+        {
+            break;
+        }
+        col -= 16;
+    }
+#endif
+
+    while ( ( col > 0 ) && ( red[col - 1] == color[RED] ) &&
+        ( green[col - 1] == color[GREEN] ) && ( blue[col - 1] == color[BLUE] ) )
+    {
+        col--;
+    }
+
+    return col;
+}
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Moves right from a pixel while the pixels are the given color, or while
+ * they are not the given color. With SSE2, 16 pixels are compared at a time
+ * and the last few one at a time.
+ *
+ * @param[in] img - image structure that holds all the image's data
+ * @param[in] row - row to scan
+ * @param[in] col - column to start from
+ * @param[in] end - column to stop at
+ * @param[in] color - array that holds the 3 color values
+ * @param[in] same - true to move past pixels of the color, false to move
+ *                   past pixels of any other color
+ *
+ * @returns the first column that stops the scan, or end.
+ *
+ * @par Example
+ * @verbatim
+   // right = scanRight( img, row, col, img.cols, oldColor, true );
+   @endverbatim
+ *****************************************************************************/
+int scanRight( image& img, int row, int col, int end, int color[], bool same )
+{
+    const pixel* red = img.redgray[row];
+    const pixel* green = img.green[row];
+    const pixel* blue = img.blue[row];
+
+#ifdef FILL_SSE2
+    __m128i r = _mm_set1_epi8( ( char ) color[RED] );
+    __m128i g = _mm_set1_epi8( ( char ) color[GREEN] );
+    __m128i b = _mm_set1_epi8( ( char ) color[BLUE] );
+    __m128i equal;
+    int skip = same ? 0xFFFF : 0;
+
+    // Step 16 pixels at a time while none of them stop the scan.
+    while ( col + 16 <= end )
+    {
+        equal = _mm_and_si128( _mm_cmpeq_epi8( r, _mm_loadu_si128(
+            ( const __m128i* ) ( red + col ) ) ),
+            _mm_and_si128( _mm_cmpeq_epi8( g, _mm_loadu_si128(
+            ( const __m128i* ) ( green + col ) ) ),
+            _mm_cmpeq_epi8( b, _mm_loadu_si128(
+            ( const __m128i* ) ( blue + col ) ) ) ) );
+        if ( _mm_movemask_epi8( equal ) != skip )
+        {
+            break;
+        }
+        col += 16;
+    }
+#endif
 
-    // Assign new pixel values
-    img.redgray[row][col] = newColor[RED];
-    img.green[row][col] = newColor[GREEN];
-    img.blue[row][col] = newColor[BLUE];
+    while ( ( col < end ) && ( ( ( red[col] == color[RED] ) &&
+        ( green[col] == color[GREEN] ) && ( blue[col] == color[BLUE] ) ) ==
+        same ) )
+    {
+        col++;
+    }
 
-    // Fill adjacent pixels
-    fill( img, row - 1, col, newColor, oldColor );
-    fill( img, row, col + 1, newColor, oldColor );
-    fill( img, row + 1, col, newColor, oldColor );
-    fill( img, row, col - 1, newColor, oldColor );
+    return col;
 }
 
 
@@ -404,7 +710,8 @@ void fill( image& img, int row, int col, int newColor[], int oldColor[] )
 bool getStartColor( image img, int oldColor[], int row, int col )
 {
     // If pixel is out of scope, return false
-    if ( (row < 0 ) || ( row > img.rows ) || ( col < 0 ) || ( col > img.cols ) )
+    if ( (row < 0 ) || ( row >= img.rows ) || ( col < 0 ) ||
+        ( col >= img.cols ) )
     {
         return false;
     }
@@ -0,0 +1,720 @@
+/** **************************************************************************
+ * @file
+ *
+ * @brief Holds the convolution engine that runs any integer or floating
+ *        point kernel over an image, and the functions that read kernels
+ *        from a kernel file or the command line.
+ ****************************************************************************/
+#include "netPBM.h"
+#include <cmath>
+#include <climits>
+#include <sstream>
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Works out the weighted sums for one row of output. The window for output
+ * j starts at column j of src and takes height rows of width samples each.
+ * The sizes given as template arguments are known when compiling, so the
+ * loops over the weights are unrolled and the loop over j is vectorised by
+ * the compiler. Instances for the common sizes are picked by pickWeighRow,
+ * every other size goes through the 0, 0 instance, which adds in one weight
+ * at a time across the whole row so its inner loop still vectorises.
+ *
+ * @param[in]  src - top left sample of the window for the first output.
+ * @param[in]  stride - distance between two rows of src.
+ * @param[in]  weights - height * width weights, row by row.
+ * @param[in]  height - number of rows of weights.
+ * @param[in]  width - number of columns of weights.
+ * @param[out] sums - weighted sums, one for each output.
+ * @param[in]  count - number of outputs.
+ *
+ * @par Example
+ * @verbatim
+   // weighRow<3, 3, pixel, int>( src, stride, weights, 3, 3, sums, cols );
+   @endverbatim
+ *****************************************************************************/
+template <int H, int W, typename In, typename Acc>
+static void weighRow( const In* src, ptrdiff_t stride, const Acc* weights,
+    int height, int width, Acc* sums, int count )
+{
+    int j;
+    int ky;
+    int kx;
+    Acc sum;
+    Acc weight;
+    const In* line;
+
+    // Sizes known when compiling, keep each sum in a register.
+    if ( ( H > 0 ) && ( W > 0 ) )
+    {
+        for ( j = 0; j < count; j++ )
+        {
+            sum = 0;
+            for ( ky = 0; ky < H; ky++ )
+            {
+                for ( kx = 0; kx < W; kx++ )
+                {
+                    sum += weights[ky * W + kx] * ( Acc ) src[ky * stride + j +
+                        kx];
+                }
+            }
+            sums[j] = sum;
+        }
+        return;
+    }
+
+    // Any other size, sweep each weight across the whole row.
+    for ( j = 0; j < count; j++ )
+    {
+        sums[j] = 0;
+    }
+    for ( ky = 0; ky < height; ky++ )
+    {
+        for ( kx = 0; kx < width; kx++ )
+        {
+            weight = weights[ky * width + kx];
+            line = src + ky * stride + kx;
+            if ( weight == 0 )
+            {
+                continue;
+            }
+            for ( j = 0; j < count; j++ )
+            {
+                sums[j] += weight * ( Acc ) line[j];
+            }
+        }
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Picks the instance of weighRow for a kernel size. There are instances for
+ * the 3x3 and 5x5 kernels and for the 1x3, 1x5, 1x7 and 3x1, 5x1, 7x1
+ * passes a separable kernel is split into, anything else gets the general
+ * instance.
+ *
+ * @param[in]  height - number of rows of weights.
+ * @param[in]  width - number of columns of weights.
+ *
+ * @returns the weighRow instance to use.
+ *
+ * @par Example
+ * @verbatim
+   // weigh = pickWeighRow<pixel, int>( 3, 3 );
+   @endverbatim
+ *****************************************************************************/
+template <typename In, typename Acc>
+static void ( *pickWeighRow( int height, int width ) )( const In*, ptrdiff_t,
+    const Acc*, int, int, Acc*, int )
+{
+    if ( ( height == 3 ) && ( width == 3 ) )
+    {
+        return weighRow<3, 3, In, Acc>;
+    }
+    if ( ( height == 5 ) && ( width == 5 ) )
+    {
+        return weighRow<5, 5, In, Acc>;
+    }
+    if ( height == 1 )
+    {
+        if ( width == 3 )
+        {
+            return weighRow<1, 3, In, Acc>;
+        }
+        if ( width == 5 )
+        {
+            return weighRow<1, 5, In, Acc>;
+        }
+        if ( width == 7 )
+        {
+            return weighRow<1, 7, In, Acc>;
+        }
+    }
+    if ( width == 1 )
+    {
+        if ( height == 3 )
+        {
+            return weighRow<3, 1, In, Acc>;
+        }
+        if ( height == 5 )
+        {
+            return weighRow<5, 1, In, Acc>;
+        }
+        if ( height == 7 )
+        {
+            return weighRow<7, 1, In, Acc>;
+        }
+    }
+
+    return weighRow<0, 0, In, Acc>;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Turns integer weighted sums into pixels. Each sum is divided by the
+ * divisor, rounding towards 0, and cropped to 0 and 255.
+ *
+ * @param[in]  sums - weighted sums.
+ * @param[in]  divisor - what each sum is divided by, not 0.
+ * @param[out] dest - pixels.
+ * @param[in]  count - number of sums.
+ *
+ * @par Example
+ * @verbatim
+   // finishRow( sums, 9, dest, count );
+   @endverbatim
+ *****************************************************************************/
+static void finishRow( const int* sums, int divisor, pixel* dest, int count )
+{
+    int j;
+    int value;
+
+    for ( j = 0; j < count; j++ )
+    {
+        value = divisor == 1 ? sums[j] : sums[j] / divisor;
+        if ( value < 0 )
+        {
+            value = 0;
+        }
+        else if ( value > 255 )
+        {
+            value = 255;
+        }
+        dest[j] = ( pixel ) value;
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Turns floating point weighted sums into pixels. The weights already have
+ * the divisor folded in, so each sum is cropped to 0 and 255 and the
+ * fraction dropped. A sum that should be a whole number can come out a
+ * hair under it, so a little is added first to keep it from dropping to
+ * one less.
+ *
+ * @param[in]  sums - weighted sums.
+ * @param[in]  divisor - not used, the weights are already divided.
+ * @param[out] dest - pixels.
+ * @param[in]  count - number of sums.
+ *
+ * @par Example
+ * @verbatim
+   // finishRow( sums, 1.0, dest, count );
+   @endverbatim
+ *****************************************************************************/
+static void finishRow( const double* sums, double divisor, pixel* dest,
+    int count )
+{
+    int j;
+    double value;
+
+    ( void ) divisor;
+    for ( j = 0; j < count; j++ )
+    {
+        value = sums[j] + 1e-9;
+        if ( !( value > 0 ) )
+        {
+            value = 0;
+        }
+        else if ( value > 255 )
+        {
+            value = 255;
+        }
+        dest[j] = ( pixel ) value;
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Splits a kernel into a column and a row of weights if it is separable,
+ * meaning every row of it is a multiple of one row. Row r0, the first row
+ * with a weight that is not 0, is the row of weights, and the column of
+ * weights is column j0 of the kernel, where j0 is the first weight in row
+ * r0 that is not 0. Running the row and then the column over the image
+ * gives pivot times the result of the full kernel, where pivot is the
+ * weight at r0, j0.
+ *
+ * @param[in]  kernel - kernel to split.
+ * @param[out] column - height weights down the kernel.
+ * @param[out] row - width weights across the kernel.
+ * @param[out] pivot - weight at r0, j0.
+ *
+ * @returns true if the kernel is separable.
+ *
+ * @par Example
+ * @verbatim
+   // if ( splitKernel( kernel, column, row, pivot ) )
+   @endverbatim
+ *****************************************************************************/
+static bool splitKernel( const convKernel& kernel, vector<double>& column,
+    vector<double>& row, double& pivot )
+{
+    int i;
+    int j;
+    int r0 = -1;
+    int j0 = -1;
+    double largest = 0;
+    double error;
+    const double* w = kernel.weights.data();
+
+    // Find the first weight that is not 0.
+    for ( i = 0; ( i < kernel.height ) && ( r0 < 0 ); i++ )
+    {
+        for ( j = 0; ( j < kernel.width ) && ( j0 < 0 ); j++ )
+        {
+            if ( w[i * kernel.width + j] != 0 )
+            {
+                r0 = i;
+                j0 = j;
+            }
+        }
+    }
+    if ( r0 < 0 )
+    {
+        return false;
+    }
+    for ( i = 0; i < kernel.height * kernel.width; i++ )
+    {
+        largest = fabs( w[i] ) > largest ? fabs( w[i] ) : largest;
+    }
+
+    // Every 2x2 corner with row r0 and column j0 must cross multiply evenly.
+    pivot = w[r0 * kernel.width + j0];
+    for ( i = 0; i < kernel.height; i++ )
+    {
+        for ( j = 0; j < kernel.width; j++ )
+        {
+            error = w[i * kernel.width + j] * pivot -
+                w[r0 * kernel.width + j] * w[i * kernel.width + j0];
+            if ( fabs( error ) > 1e-9 * largest * largest )
+            {
+                return false;
+            }
+        }
+    }
+
+    column.resize( kernel.height );
+    row.resize( kernel.width );
+    for ( i = 0; i < kernel.height; i++ )
+    {
+        column[i] = w[i * kernel.width + j0];
+    }
+    for ( j = 0; j < kernel.width; j++ )
+    {
+        row[j] = w[r0 * kernel.width + j];
+    }
+
+    return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Turns a kernel with decimal weights or divisor into one with whole
+ * numbers that gives the same pixels, by multiplying the weights and the
+ * divisor by the smallest power of 10 up to 1000000 that makes all of
+ * them whole. Both are multiplied by the same amount, so the weighted sum
+ * divided by the divisor does not change, but it can be worked out exactly
+ * with integers. Kernels that are already whole are copied as they are.
+ *
+ * @param[in]  kernel - kernel to scale.
+ * @param[out] scaled - kernel with whole number weights and divisor.
+ *
+ * @returns true if a power of 10 made every number whole.
+ *
+ * @par Example
+ * @verbatim
+   // if ( scaleKernel( kernel, scaled ) )
+   @endverbatim
+ *****************************************************************************/
+static bool scaleKernel( const convKernel& kernel, convKernel& scaled )
+{
+    int i;
+    double power;
+    double value;
+    bool whole = false;
+
+    scaled = kernel;
+    for ( power = 1; ( power <= 1e6 ) && !whole; power *= 10 )
+    {
+        whole = true;
+        for ( i = -1; ( i < ( int ) kernel.weights.size() ) && whole; i++ )
+        {
+            value = ( i < 0 ? kernel.divisor : kernel.weights[i] ) * power;
+            whole = fabs( value - round( value ) ) <=
+                1e-9 * ( fabs( value ) > 1 ? fabs( value ) : 1 );
+        }
+        if ( whole )
+        {
+            scaled.divisor = round( kernel.divisor * power );
+            for ( i = 0; i < ( int ) kernel.weights.size(); i++ )
+            {
+                scaled.weights[i] = round( kernel.weights[i] * power );
+            }
+        }
+    }
+
+    return whole;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Runs a kernel over one plane. The output rows are split into bands that
+ * are done at the same time, see parallelRows. If it was split, the row of
+ * weights is run across the rows of a band, and the halo rows the kernel
+ * reaches above and below it, into a band of sums, then the column of
+ * weights is run down those sums. Otherwise the whole kernel is run for
+ * each output row. Rows and columns the kernel does not fit over are set
+ * to 0.
+ *
+ * @param[in]  src - plane to read.
+ * @param[in]  srcStride - distance between two rows of src.
+ * @param[out] dest - plane to write.
+ * @param[in]  destStride - distance between two rows of dest.
+ * @param[in]  rows - number of rows in the planes.
+ * @param[in]  cols - number of columns in the planes.
+ * @param[in]  kernel - kernel to run, the full one or only its size.
+ * @param[in]  full - full kernel weights, used if row is empty.
+ * @param[in]  column - column of weights of a split kernel.
+ * @param[in]  row - row of weights of a split kernel, empty if not split.
+ * @param[in]  divisor - what each final sum is divided by.
+ *
+ * @par Example
+ * @verbatim
+   // convolvePlane<int>( src, stride, dest, stride, rows, cols, kernel,
+   //     full, column, row, divisor );
+   @endverbatim
+ *****************************************************************************/
+template <typename Acc>
+static void convolvePlane( const pixel* src, int srcStride, pixel* dest,
+    int destStride, int rows, int cols, const convKernel& kernel,
+    const vector<Acc>& full, const vector<Acc>& column,
+    const vector<Acc>& row, Acc divisor )
+{
+    int i;
+    int ry = kernel.height / 2;
+    int rx = kernel.width / 2;
+    int inside = cols - 2 * rx;
+    void ( *weighPixels )( const pixel*, ptrdiff_t, const Acc*, int, int,
+        Acc*, int );
+    void ( *weighSums )( const Acc*, ptrdiff_t, const Acc*, int, int, Acc*,
+        int );
+
+    // Set the border rows and columns to 0.
+    for ( i = 0; i < rows; i++ )
+    {
+        if ( ( i < ry ) || ( i >= rows - ry ) || ( inside <= 0 ) )
+        {
+            fillPixels( dest + ( size_t ) i * destStride, cols, 0 );
+        }
+        else
+        {
+            fillPixels( dest + ( size_t ) i * destStride, rx, 0 );
+            fillPixels( dest + ( size_t ) i * destStride + cols - rx, rx, 0 );
+        }
+    }
+    if ( ( inside <= 0 ) || ( rows - 2 * ry <= 0 ) )
+    {
+        return;
+    }
+
+    // Not separable, run the whole kernel for each row of each band.
+    if ( row.empty() )
+    {
+        weighPixels = pickWeighRow<pixel, Acc>( kernel.height, kernel.width );
+        parallelRows( rows - 2 * ry, BAND_ROWS, [&]( int first, int last )
+            {
+                int i;
+                vector<Acc> sums( inside );
+
+                for ( i = first + ry; i < last + ry; i++ )
+                {
+                    weighPixels( src + ( size_t ) ( i - ry ) * srcStride,
+                        srcStride, full.data(), kernel.height, kernel.width,
+                        sums.data(), inside );
+                    finishRow( sums.data(), divisor, dest + ( size_t ) i *
+                        destStride + rx, inside );
+                }
+            } );
+        return;
+    }
+
+    // Run the row of weights across the rows of each band and the halo rows
+    // around it, then the column down the band.
+    weighPixels = pickWeighRow<pixel, Acc>( 1, kernel.width );
+    weighSums = pickWeighRow<Acc, Acc>( kernel.height, 1 );
+    parallelRows( rows - 2 * ry, BAND_ROWS, [&]( int first, int last )
+        {
+            int i;
+            int height = last - first + 2 * ry;
+            vector<Acc> sums( inside );
+            vector<Acc> passed( ( size_t ) height * inside );
+
+            for ( i = 0; i < height; i++ )
+            {
+                weighPixels( src + ( size_t ) ( first + i ) * srcStride,
+                    srcStride, row.data(), 1, kernel.width, passed.data() +
+                    ( size_t ) i * inside, inside );
+            }
+            for ( i = first; i < last; i++ )
+            {
+                weighSums( passed.data() + ( size_t ) ( i - first ) * inside,
+                    inside, column.data(), kernel.height, 1, sums.data(),
+                    inside );
+                finishRow( sums.data(), divisor, dest + ( size_t ) ( i + ry ) *
+                    destStride + rx, inside );
+            }
+        } );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Runs a convolution kernel over each plane of the image. Each new pixel is
+ * the sum of the pixels under the kernel times their weights, divided by the
+ * divisor, rounded towards 0 and cropped to 0 and 255. Pixels the kernel
+ * does not fit over at the edges are set to 0, the same as sharpen, smooth,
+ * and blur do, so those can be written as kernels and give the same image.
+ * If every weight and the divisor are whole numbers, or can be made whole
+ * by multiplying them all by the same power of 10, the sums are done with
+ * integers and the result is exact, otherwise they are done in floating
+ * point. A separable kernel is run as a row pass and a column pass, which
+ * costs height + width multiplies a pixel instead of height * width.
+ *
+ * @param[in]  kernel - kernel to run over the image.
+ *
+ * @par Example
+ * @verbatim
+   // img.convolve( kernel );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::convolve( const convKernel& kernel )
+{
+    int i;
+    int p;
+    size_t taps = kernel.weights.size();
+    bool whole;
+    bool split;
+    double pivot = 1;
+    double total = 0;
+    double rowTotal = 0;
+    double columnTotal = 0;
+    vector<double> column;
+    vector<double> row;
+    convKernel scaled;
+    netPBM temp;
+
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
+
+    // Share the pixels with temp to read from and get fresh planes to write,
+    // leaving the image as it was if there is no room for them.
+    temp = *this;
+    if ( !allocImage( temp.rows, temp.cols ) )
+    {
+        *this = move( temp );
+        return;
+    }
+    const pixel* from[3] = { temp.redGray, temp.green, temp.blue };
+    pixel* to[3] = { redGray, green, blue };
+
+    // See if the sums can be done in integers without overflowing.
+    whole = scaleKernel( kernel, scaled ) &&
+        ( fabs( scaled.divisor ) <= INT_MAX );
+    for ( i = 0; i < ( int ) taps; i++ )
+    {
+        total += fabs( scaled.weights[i] );
+    }
+    whole = whole && ( 255 * total <= INT_MAX );
+    split = splitKernel( scaled, column, row, pivot );
+    if ( split )
+    {
+        for ( i = 0; i < scaled.height; i++ )
+        {
+            columnTotal += fabs( column[i] );
+        }
+        for ( i = 0; i < scaled.width; i++ )
+        {
+            rowTotal += fabs( row[i] );
+        }
+    }
+
+    if ( whole )
+    {
+        // Split integer kernels are exact, the extra pivot divides out.
+        split = split && ( 255 * rowTotal * columnTotal <= INT_MAX ) &&
+            ( fabs( pivot * scaled.divisor ) <= INT_MAX );
+        vector<int> full( scaled.weights.begin(), scaled.weights.end() );
+        vector<int> columnWeights( column.begin(), column.end() );
+        vector<int> rowWeights;
+        if ( split )
+        {
+            rowWeights.assign( row.begin(), row.end() );
+        }
+        for ( p = 0; p < 3; p++ )
+        {
+            convolvePlane<int>( from[p], temp.stride, to[p], stride, rows,
+                cols, scaled, full, columnWeights, rowWeights, split ?
+                ( int ) ( pivot * scaled.divisor ) : ( int ) scaled.divisor );
+        }
+        return;
+    }
+
+    // Floating point, fold the divisor and the pivot into the weights.
+    vector<double> full( taps );
+    vector<double> columnWeights( column.size() );
+    vector<double> rowWeights;
+    for ( i = 0; i < ( int ) taps; i++ )
+    {
+        full[i] = scaled.weights[i] / scaled.divisor;
+    }
+    if ( split )
+    {
+        rowWeights.assign( row.begin(), row.end() );
+        for ( i = 0; i < scaled.height; i++ )
+        {
+            columnWeights[i] = column[i] / pivot / scaled.divisor;
+        }
+    }
+    for ( p = 0; p < 3; p++ )
+    {
+        convolvePlane<double>( from[p], temp.stride, to[p], stride, rows, cols,
+            scaled, full, columnWeights, rowWeights, 1.0 );
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Reads a kernel out of text. The text holds the height and the width of
+ * the kernel, then its height * width weights row by row, then an optional
+ * divisor that is 1 if left out. The numbers can be split up by spaces,
+ * new lines, or commas, and a # starts a comment that runs to the end of
+ * the line. The height and width must be odd so the kernel has a center.
+ *
+ * @param[in]  text - text holding the kernel.
+ * @param[out] kernel - kernel that was read.
+ *
+ * @returns true if the text held a valid kernel and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( parseKernel( "3 3  0 -1 0  -1 5 -1  0 -1 0", kernel ) )
+   @endverbatim
+ *****************************************************************************/
+bool parseKernel( string text, convKernel& kernel )
+{
+    size_t i;
+    bool comment = false;
+    double value;
+    string extra;
+    istringstream in;
+
+    // Blank out the comments and turn commas into spaces.
+    for ( i = 0; i < text.size(); i++ )
+    {
+        comment = ( comment || ( text[i] == '#' ) ) && ( text[i] != '\n' );
+        if ( comment || ( text[i] == ',' ) )
+        {
+            text[i] = ' ';
+        }
+    }
+    in.str( text );
+
+    // Read the size and check it has a center.
+    if ( !( in >> kernel.height >> kernel.width ) || ( kernel.height < 1 ) ||
+        ( kernel.width < 1 ) || ( kernel.height % 2 == 0 ) ||
+        ( kernel.width % 2 == 0 ) || ( kernel.height > 999 ) ||
+        ( kernel.width > 999 ) )
+    {
+        return false;
+    }
+
+    // Read the weights and the divisor, if it is there.
+    kernel.weights.clear();
+    for ( i = 0; i < ( size_t ) kernel.height * kernel.width; i++ )
+    {
+        if ( !( in >> value ) || !isfinite( value ) )
+        {
+            return false;
+        }
+        kernel.weights.push_back( value );
+    }
+    kernel.divisor = 1;
+    if ( in >> value )
+    {
+        kernel.divisor = value;
+    }
+
+    return ( kernel.divisor != 0 ) && isfinite( kernel.divisor ) &&
+        !( in >> extra );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets a kernel for the -k option. If name is a file that can be opened the
+ * kernel is read from it, otherwise name itself is read as the kernel, so a
+ * small one can be typed right on the command line. See parseKernel for the
+ * layout.
+ *
+ * @param[in]  name - kernel file, or the kernel itself.
+ * @param[out] kernel - kernel that was read.
+ *
+ * @returns true if a valid kernel was read and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( !readKernel( "edges.txt", kernel ) )
+   @endverbatim
+ *****************************************************************************/
+bool readKernel( string name, convKernel& kernel )
+{
+    ifstream fin;
+    ostringstream text;
+
+    fin.open( name );
+    if ( !fin.is_open() )
+    {
+        return parseKernel( name, kernel );
+    }
+
+    text << fin.rdbuf();
+    fin.close();
+
+    return parseKernel( text.str(), kernel );
+}
@@ -0,0 +1,815 @@
+/** **************************************************************************
+ * @file
+ *
+ * @brief Holds the functions that read images straight out of a memory
+ *        mapped file and that parse and format the text of P3 and P2
+ *        images.
+ ****************************************************************************/
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "netPBM.h"
+#include <cctype>
+#include <climits>
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Constructor for the mappedFile class. Starts with nothing mapped.
+ *
+ * @par Example
+ * @verbatim
+   // mappedFile file;
+   @endverbatim
+ *****************************************************************************/
+mappedFile::mappedFile()
+{
+    data = nullptr;
+    size = 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * The deconstructor for the mappedFile class. Unmaps the file if one is
+ * mapped.
+ *
+ * @par Example
+ * @verbatim
+   // Don't call the deconstructor, does it automatically.
+   @endverbatim
+ *****************************************************************************/
+mappedFile::~mappedFile()
+{
+    close();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Unmaps the file.
+ *
+ * @par Example
+ * @verbatim
+   // file.close();
+   @endverbatim
+ *****************************************************************************/
+void mappedFile::close()
+{
+    if ( data != nullptr )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile( data );
+#else
+        munmap( ( void* ) data, size );
+#endif
+    }
+
+    data = nullptr;
+    size = 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the start of the mapped file.
+ *
+ * @returns a pointer to the first byte of the file.
+ *
+ * @par Example
+ * @verbatim
+   // pos = file.getData();
+   @endverbatim
+ *****************************************************************************/
+const pixel* mappedFile::getData() const
+{
+    return data;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the number of bytes in the mapped file.
+ *
+ * @returns the size of the file.
+ *
+ * @par Example
+ * @verbatim
+   // end = file.getData() + file.getSize();
+   @endverbatim
+ *****************************************************************************/
+size_t mappedFile::getSize() const
+{
+    return size;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Maps a file read only into memory and tells the system it will be read
+ * from front to back so it can read ahead. Empty files and things that
+ * cannot be mapped, like pipes, fail.
+ *
+ * @param[in]  filename - name of the file to map.
+ *
+ * @returns true if successful and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( !file.open( filename ) )
+   @endverbatim
+ *****************************************************************************/
+bool mappedFile::open( string filename )
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+    LARGE_INTEGER fileSize;
+
+    // Open the file and find its size.
+    file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+    if ( !GetFileSizeEx( file, &fileSize ) || ( fileSize.QuadPart == 0 ) )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    // Map the whole file. The view keeps the file open after the handles close.
+    mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( mapping != NULL )
+    {
+        data = ( const pixel* ) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        CloseHandle( mapping );
+    }
+    CloseHandle( file );
+
+    if ( data == nullptr )
+    {
+        return false;
+    }
+    size = ( size_t ) fileSize.QuadPart;
+#else
+    int fd;
+    struct stat info;
+    void* view;
+
+    // Open the file and find its size.
+    fd = ::open( filename.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+    if ( ( fstat( fd, &info ) != 0 ) || !S_ISREG( info.st_mode ) ||
+         ( info.st_size == 0 ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    // Map the whole file. The mapping keeps the file open after fd closes.
+    view = mmap( nullptr, ( size_t ) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( view == MAP_FAILED )
+    {
+        return false;
+    }
+
+    // Ask for the pages to be read ahead since they are read in order.
+    madvise( view, ( size_t ) info.st_size, MADV_SEQUENTIAL );
+    madvise( view, ( size_t ) info.st_size, MADV_WILLNEED );
+
+    data = ( const pixel* ) view;
+    size = ( size_t ) info.st_size;
+#endif
+
+    return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Formats one row of an image as P3 or P2 text. Each sample is copied from a
+ * table of the text for 0 to 255 instead of being converted one digit at a
+ * time. With the pixel per line layout every pixel is put on its own line,
+ * the samples of a color pixel separated by spaces. With the packed layout
+ * samples are separated by spaces, lines are kept to ASCII_LINE_LENGTH
+ * characters and the row ends with a newline. dest must have room for
+ * ASCII_BYTES_PER_PIXEL bytes per pixel.
+ *
+ * @param[in]  red - red or gray samples.
+ * @param[in]  green - green samples, nullptr for a gray row.
+ * @param[in]  blue - blue samples, nullptr for a gray row.
+ * @param[in]  count - number of pixels.
+ * @param[in]  packed - true for the packed layout.
+ * @param[out] dest - where the text goes.
+ *
+ * @returns the number of bytes written to dest.
+ *
+ * @par Example
+ * @verbatim
+   // length = formatAsciiRow( red, green, blue, cols, false, text );
+   @endverbatim
+ *****************************************************************************/
+size_t formatAsciiRow( const pixel* red, const pixel* green, const pixel* blue,
+    int count, bool packed, char* dest )
+{
+    static const struct digitTable
+    {
+        char text[256][4];  /**< Digits of each value followed by a space */
+        int length[256];    /**< Number of digits in each value           */
+
+        digitTable()
+        {
+            int value;
+
+            for ( value = 0; value < 256; value++ )
+            {
+                length[value] = ( value >= 100 ) ? 3 : ( value >= 10 ) ? 2 : 1;
+                text[value][0] = ( char ) ( '0' + value / 100 );
+                text[value][1] = ( char ) ( '0' + value / 10 % 10 );
+                text[value][2] = ( char ) ( '0' + value % 10 );
+                text[value][3] = ' ';
+
+                // Shift the digits to the front, keeping the space after.
+                memmove( text[value], text[value] + 3 - length[value],
+                    length[value] + 1 );
+            }
+        }
+    } digits;
+
+    int j;
+    int k;
+    int samples;
+    pixel value;
+    char* start = dest;
+    char* line = dest;
+    const pixel* planes[3] = { red, green, blue };
+
+    samples = ( green == nullptr ) ? 1 : 3;
+    for ( j = 0; j < count; j++ )
+    {
+        for ( k = 0; k < samples; k++ )
+        {
+            value = planes[k][j];
+
+            // Start a new line before the packed line gets too long.
+            if ( packed && ( dest != line ) &&
+                 ( dest - line + digits.length[value] > ASCII_LINE_LENGTH ) )
+            {
+                dest[-1] = '\n';
+                line = dest;
+            }
+
+            // Copy all 4 bytes, the space is overwritten or kept as needed.
+            memcpy( dest, digits.text[value], 4 );
+            dest += digits.length[value] + 1;
+        }
+
+        if ( !packed )
+        {
+            dest[-1] = '\n';
+        }
+    }
+
+    if ( packed && ( dest != start ) )
+    {
+        dest[-1] = '\n';
+    }
+
+    return dest - start;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Parses up to count white space separated decimal samples out of the text of
+ * a P3 image. Samples of 1 to 3 digits, which is every valid sample, are
+ * parsed without a loop. Like reading them with >> into an int and storing
+ * that in a pixel, a sample may have a sign and only its low 8 bits are kept.
+ * Parsing stops early at the end of the text or at anything that is not a
+ * number, and pos is left there.
+ *
+ * @param[in,out]  pos - where to start parsing, moved past what was parsed.
+ * @param[in]      end - one past the last byte that may be read.
+ * @param[out]     dest - where the samples go.
+ * @param[in]      count - most samples to parse.
+ *
+ * @returns the number of samples parsed.
+ *
+ * @par Example
+ * @verbatim
+   // got = parseSamples( pos, end, row, 3 * cols );
+   @endverbatim
+ *****************************************************************************/
+int parseSamples( const pixel*& pos, const pixel* end, pixel* dest, int count )
+{
+    int n;
+    int length;
+    bool negative;
+    unsigned int value;
+    unsigned int d0;
+    unsigned int d1;
+    unsigned int d2;
+    const pixel* p = pos;
+
+    for ( n = 0; n < count; n++ )
+    {
+        // Skip the white space before the sample.
+        while ( ( p < end ) && ( ( *p == ' ' ) || ( ( *p >= '\t' ) && ( *p <= '\r' ) ) ) )
+        {
+            p++;
+        }
+        if ( p == end )
+        {
+            break;
+        }
+
+        negative = false;
+        if ( ( *p == '-' ) || ( *p == '+' ) )
+        {
+            negative = ( *p == '-' );
+            p++;
+        }
+
+        if ( end - p >= 4 )
+        {
+            // Find the number of digits, up to 3, and combine them without
+            // branching on the length.
+            d0 = ( unsigned int ) p[0] - '0';
+            d1 = ( unsigned int ) p[1] - '0';
+            d2 = ( unsigned int ) p[2] - '0';
+            length = ( d0 <= 9 );
+            length += ( length == 1 ) & ( d1 <= 9 );
+            length += ( length == 2 ) & ( d2 <= 9 );
+            if ( length == 0 )
+            {
+                break;
+            }
+            value = ( length == 1 ) ? d0 :
+                ( length == 2 ) ? d0 * 10 + d1 : d0 * 100 + d1 * 10 + d2;
+            p += length;
+        }
+        else
+        {
+            if ( ( p == end ) || ( ( unsigned int ) *p - '0' > 9 ) )
+            {
+                break;
+            }
+            value = 0;
+        }
+
+        // Longer samples and those near the end of the text finish here.
+        while ( ( p < end ) && ( ( unsigned int ) *p - '0' <= 9 ) )
+        {
+            value = value * 10 + ( *p - '0' );
+            p++;
+        }
+
+        dest[n] = ( pixel ) ( negative ? 0u - value : value );
+    }
+
+    pos = p;
+    return n;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Counts the samples parseSamples would find in a stretch of P3 text,
+ * without keeping them. The samples are parsed a block at a time into a
+ * small buffer that is thrown away.
+ *
+ * @param[in]    pos - first byte of the text.
+ * @param[in]    end - one past the last byte of the text.
+ * @param[out]   stopped - true if parsing stopped at something that is not
+ *                         a number before the end of the text.
+ *
+ * @returns the number of samples before the end or the bad sample.
+ *
+ * @par Example
+ * @verbatim
+   // count = countSamples( pos, end, stopped );
+   @endverbatim
+ *****************************************************************************/
+static size_t countSamples( const pixel* pos, const pixel* end, bool& stopped )
+{
+    int got;
+    size_t total = 0;
+    pixel scratch[4096];
+
+    do
+    {
+        got = parseSamples( pos, end, scratch, 4096 );
+        total += got;
+    } while ( got == 4096 );
+
+    stopped = ( pos != end );
+    return total;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Fills the planes from the text of a P3 image. Large text is split into
+ * about PARSE_CHUNK_SIZE byte chunks, one for each thread at most, with
+ * each split moved up to the next white space so no sample is cut in two.
+ * The chunks are parsed at the same time twice. The first time only counts
+ * the samples in each chunk. Adding up the counts of the chunks before it
+ * gives the sample each chunk starts at, and the second time the chunks
+ * parse their samples straight into the planes from there, see
+ * placeSamples. If the text runs out or holds something that is not a
+ * number, the rest of the pixels are set to 0, the same as parsing the
+ * whole text in order.
+ *
+ * @param[in]    pos - first byte of the raster text.
+ * @param[in]    end - one past the last byte of the text.
+ *
+ * @par Example
+ * @verbatim
+   // parseAscii( pos, end );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::parseAscii( const pixel* pos, const pixel* end )
+{
+    int i;
+    int k;
+    int chunks;
+    size_t got;
+    size_t needed;
+    size_t rowSize;
+    size_t size = end - pos;
+    vector<const pixel*> bounds;
+    vector<size_t> counts;
+    vector<size_t> firsts;
+    vector<char> stopped;
+
+    rowSize = 3 * ( size_t ) cols;
+    needed = rowSize * rows;
+    if ( needed == 0 )
+    {
+        return;
+    }
+    chunks = parallelBands( ( int ) min( size / PARSE_CHUNK_SIZE + 1,
+        ( size_t ) INT_MAX ), 1 );
+
+    if ( chunks <= 1 )
+    {
+        got = placeSamples( pos, end, 0 );
+    }
+    else
+    {
+        // Split the text, moving each split up to the next white space.
+        bounds.resize( chunks + 1 );
+        bounds[0] = pos;
+        bounds[chunks] = end;
+        for ( k = 1; k < chunks; k++ )
+        {
+            bounds[k] = max( pos + size / chunks * k, bounds[k - 1] );
+            while ( ( bounds[k] < end ) && !( ( *bounds[k] == ' ' ) ||
+                ( ( *bounds[k] >= '\t' ) && ( *bounds[k] <= '\r' ) ) ) )
+            {
+                bounds[k]++;
+            }
+        }
+
+        // Count the samples in each chunk.
+        counts.resize( chunks );
+        stopped.resize( chunks );
+        threadPool::global().run( chunks, [&]( int c )
+            {
+                bool bad;
+
+                counts[c] = countSamples( bounds[c], bounds[c + 1], bad );
+                stopped[c] = bad;
+            } );
+
+        // Work out where each chunk starts, up to the first bad sample.
+        firsts.resize( chunks );
+        got = 0;
+        for ( k = 0; k < chunks; k++ )
+        {
+            firsts[k] = got;
+            got += counts[k];
+            if ( stopped[k] )
+            {
+                chunks = k + 1;
+            }
+        }
+        got = min( got, needed );
+
+        threadPool::global().run( chunks, [&]( int c )
+            {
+                placeSamples( bounds[c], bounds[c + 1], firsts[c] );
+            } );
+    }
+
+    // Set the samples that were never found to 0, finishing the row the
+    // text ran out in and then filling whole rows.
+    pixel* planes[3] = { redGray, green, blue };
+    for ( ; ( got < needed ) && ( got % rowSize != 0 ); got++ )
+    {
+        planes[got % 3][got / rowSize * stride + got % rowSize / 3] = 0;
+    }
+    for ( i = ( int ) ( got / rowSize ); i < rows; i++ )
+    {
+        for ( k = 0; k < 3; k++ )
+        {
+            fillPixels( planes[k] + ( size_t ) i * stride, cols, 0 );
+        }
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Parses the header of a .ppm image in place. Reads the magic number, the
+ * comments, the width, the height and the max color value, which is skipped
+ * like readHeader does. Comments may appear anywhere between the values.
+ * Afterwards pos points at the first byte of pixel data. A width or height
+ * over INT_MAX / 3 is a bad header, so three samples across a row still fit
+ * in an int.
+ *
+ * @param[in,out]  pos - where to start reading, moved past the header.
+ * @param[in]      end - one past the last byte that may be read.
+ * @param[out]     magicNum - magic number of the image.
+ * @param[out]     width - number of columns in the image.
+ * @param[out]     height - number of rows in the image.
+ *
+ * @returns true if a full header was found and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( !parseHeader( pos, end, magicNum, width, height ) )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::parseHeader( const pixel*& pos, const pixel* end, string& magicNum,
+    int& width, int& height )
+{
+    int values[3];
+    int i;
+    const pixel* start;
+
+    // Magic number is the first two bytes.
+    if ( end - pos < 2 )
+    {
+        return false;
+    }
+    magicNum.assign( ( const char* ) pos, 2 );
+    pos += 2;
+
+    comments.clear();
+    for ( i = 0; i < 3; i++ )
+    {
+        // Skip white space and keep any comment lines.
+        while ( ( pos < end ) && ( isspace( *pos ) || ( *pos == '#' ) ) )
+        {
+            if ( *pos == '#' )
+            {
+                start = pos;
+                while ( ( pos < end ) && ( *pos != '\n' ) )
+                {
+                    pos++;
+                }
+                comments.append( ( const char* ) start, pos - start );
+                comments += '\n';
+            }
+            if ( pos < end )
+            {
+                pos++;
+            }
+        }
+
+        // Read the number.
+        if ( ( pos == end ) || !isdigit( *pos ) )
+        {
+            return false;
+        }
+        values[i] = 0;
+        while ( ( pos < end ) && isdigit( *pos ) )
+        {
+            // Only the width and height are kept, the max color is skipped.
+            if ( i < 2 )
+            {
+                if ( values[i] > ( INT_MAX / 3 - ( *pos - '0' ) ) / 10 )
+                {
+                    return false;
+                }
+                values[i] = values[i] * 10 + ( *pos - '0' );
+            }
+            pos++;
+        }
+    }
+
+    // A single white space character separates the header from the data.
+    if ( pos < end )
+    {
+        pos++;
+    }
+
+    width = values[0];
+    height = values[1];
+    return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Parses the samples in a stretch of P3 text straight into the planes,
+ * starting at the given sample of the image, counting across each row and
+ * then down. The samples of each row are parsed into a row buffer and the
+ * whole pixels split into the color planes with deinterleaveRGB, while the
+ * samples of a pixel cut off at either end are stored one at a time. So
+ * chunks of text parsed at the same time can share a row. Stops at the end
+ * of the text, at something that is not a number, or once the planes are
+ * full.
+ *
+ * @param[in]    pos - first byte of the text.
+ * @param[in]    end - one past the last byte of the text.
+ * @param[in]    first - sample of the image the text starts at.
+ *
+ * @returns the number of samples stored.
+ *
+ * @par Example
+ * @verbatim
+   // got = placeSamples( pos, end, 0 );
+   @endverbatim
+ *****************************************************************************/
+size_t netPBM::placeSamples( const pixel* pos, const pixel* end, size_t first )
+{
+    int got;
+    int want;
+    size_t i;
+    size_t c;
+    size_t lead;
+    size_t tail;
+    size_t offset;
+    size_t sample;
+    size_t rowSize = 3 * ( size_t ) cols;
+    size_t needed = rowSize * rows;
+    vector<pixel> row( rowSize );
+    pixel* planes[3] = { redGray, green, blue };
+
+    for ( sample = first; sample < needed; sample += got )
+    {
+        i = sample / rowSize;
+        offset = sample % rowSize;
+        want = ( int ) ( rowSize - offset );
+        got = parseSamples( pos, end, row.data() + offset, want );
+
+        // Split the whole pixels and store the cut off samples on each side.
+        lead = min( ( 3 - offset % 3 ) % 3, ( size_t ) got );
+        tail = ( got - lead ) % 3;
+        for ( c = offset; c < offset + lead; c++ )
+        {
+            planes[c % 3][i * stride + c / 3] = row[c];
+        }
+        deinterleaveRGB( row.data() + offset + lead,
+            redGray + i * stride + ( offset + lead ) / 3,
+            green + i * stride + ( offset + lead ) / 3,
+            blue + i * stride + ( offset + lead ) / 3,
+            ( int ) ( ( got - lead ) / 3 ) );
+        for ( c = offset + got - tail; c < offset + got; c++ )
+        {
+            planes[c % 3][i * stride + c / 3] = row[c];
+        }
+
+        if ( got < want )
+        {
+            return sample + got - first;
+        }
+    }
+
+    return sample > first ? sample - first : 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Reads a .ppm image by memory mapping the file. The header is parsed in
+ * place. For a P6 image each row of the raster is split straight from the
+ * mapping into the color planes, and for a P3 image the text is parsed
+ * straight from the mapping, so the file is only passed over once. If the
+ * file is cut short, the missing pixels are set to 0.
+ *
+ * @param[in]    filename - name of the file to be read in.
+ *
+ * @returns true if the image was read and false if the file could not be
+ *          mapped or is not a P3 or P6 image.
+ *
+ * @par Example
+ * @verbatim
+   // if ( !readMappedImage( filename ) )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::readMappedImage( string filename )
+{
+    mappedFile file;
+    string magicNum;
+    const pixel* pos;
+    const pixel* end;
+    int width;
+    int height;
+    int i;
+    int whole;
+    size_t available;
+
+    if ( !file.open( filename ) )
+    {
+        return false;
+    }
+
+    // Parse the header in place.
+    pos = file.getData();
+    end = pos + file.getSize();
+    if ( !parseHeader( pos, end, magicNum, width, height ) ||
+         ( ( magicNum != "P3" ) && ( magicNum != "P6" ) ) ||
+         ( width < 0 ) || ( height < 0 ) )
+    {
+        return false;
+    }
+
+    // Allocate the planes and check for success.
+    if ( !allocImage( height, width ) )
+    {
+        return false;
+    }
+
+    if ( magicNum == "P3" )
+    {
+        parseAscii( pos, end );
+        return true;
+    }
+
+    // Split each row out of the mapping.
+    for ( i = 0; i < rows; i++ )
+    {
+        available = ( size_t ) ( end - pos ) / 3;
+        whole = ( available < ( size_t ) cols ) ? ( int ) available : cols;
+
+        deinterleaveRGB( pos, redGray + ( size_t ) i * stride,
+            green + ( size_t ) i * stride, blue + ( size_t ) i * stride, whole );
+        pos += 3 * ( size_t ) whole;
+
+        // Zero whatever the file is missing.
+        if ( whole < cols )
+        {
+            memset( redGray + ( size_t ) i * stride + whole, 0, cols - whole );
+            memset( green + ( size_t ) i * stride + whole, 0, cols - whole );
+            memset( blue + ( size_t ) i * stride + whole, 0, cols - whole );
+        }
+    }
+
+    return true;
+}
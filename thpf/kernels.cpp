@@ -0,0 +1,2604 @@
+/** **************************************************************************
+ * @file
+ *
+ * @brief Holds the vectorised pixel kernels and the checks used to pick the
+ *        fastest version the cpu supports. Every kernel has a plain C++
+ *        version that the vector versions must match exactly.
+ ****************************************************************************/
+#include "netPBM.h"
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || \
+    defined( __i386__ )
+#define PBM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows any intrinsic in any function, gcc and clang need to be told
+// which instruction sets a function may use.
+#if defined( PBM_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define TARGET_SSE2 __attribute__( ( target( "sse2" ) ) )
+#define TARGET_SSSE3 __attribute__( ( target( "ssse3" ) ) )
+#define TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#define TARGET_AVX512 __attribute__( ( target( "avx512f,avx512bw" ) ) )
+#define TARGET_VBMI __attribute__( ( target( "avx512f,avx512bw,avx512vbmi" ) ) )
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#define TARGET_AVX512
+#define TARGET_VBMI
+#endif
+
+/**
+* @brief Table of the versions of each kernel that the dispatch functions call.
+*/
+struct pixelKernels
+{
+    void ( *addSaturate )( pixel* data, int count, pixel amount );
+    void ( *subSaturate )( pixel* data, int count, pixel amount );
+    void ( *invertPixels )( pixel* data, int count );
+    void ( *fillPixels )( pixel* data, int count, pixel value );
+    void ( *deinterleave )( const pixel* src, pixel* red, pixel* green,
+        pixel* blue, int count );
+    void ( *interleave )( const pixel* red, const pixel* green,
+        const pixel* blue, pixel* dest, int count );
+    void ( *grayFixed )( const pixel* red, const pixel* green,
+        const pixel* blue, pixel* gray, int count );
+    void ( *grayExact )( const pixel* red, const pixel* green,
+        const pixel* blue, pixel* gray, int count );
+    void ( *findRange )( const pixel* data, int count, pixel& low,
+        pixel& high );
+    void ( *applyLut )( pixel* data, int count, const pixel* lut );
+    void ( *sharpenRow )( const pixel* above, const pixel* center,
+        const pixel* below, pixel* dest, int count );
+    void ( *smoothRow )( const pixel* above, const pixel* center,
+        const pixel* below, pixel* dest, int count );
+    void ( *transposeTile )( const pixel* src, ptrdiff_t srcStride,
+        pixel* dest, ptrdiff_t destStride, int height, int width );
+    void ( *reversePixels )( pixel* data, int count );
+};
+
+static pixelKernels selectKernels( int features );
+
+/**
+* @brief Kernels picked for this cpu when the program starts.
+*/
+static pixelKernels active = selectKernels( cpuFeatures() );
+
+
+
+/*******************************************************************************
+ *                         CPU Feature Detection
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Asks the cpu which vector instruction sets it supports. AVX2 and AVX-512
+ * only count when the operating system also saves their registers. The
+ * answer is found once and remembered.
+ *
+ * @returns the supported cpuFeature flags or'ed together.
+ *
+ * @par Example
+ * @verbatim
+   // if ( cpuFeatures() & CPU_AVX2 )
+   @endverbatim
+ *****************************************************************************/
+int cpuFeatures()
+{
+    static const int features = []()
+    {
+        int found = 0;
+#if defined( PBM_X86 ) && defined( _MSC_VER )
+        int info[4];
+        int extended[4];
+        unsigned long long xcr0 = 0;
+
+        __cpuid( info, 0 );
+        if ( info[0] >= 7 )
+        {
+            __cpuidex( extended, 7, 0 );
+        }
+        else
+        {
+            extended[1] = 0;
+            extended[2] = 0;
+        }
+        __cpuid( info, 1 );
+
+        if ( info[3] & ( 1 << 26 ) )
+        {
+            found |= CPU_SSE2;
+        }
+        if ( info[2] & ( 1 << 9 ) )
+        {
+            found |= CPU_SSSE3;
+        }
+
+        // The wide registers need the os to save them, check with xgetbv.
+        if ( info[2] & ( 1 << 27 ) )
+        {
+            xcr0 = _xgetbv( 0 );
+        }
+        if ( ( ( xcr0 & 0x6 ) == 0x6 ) && ( extended[1] & ( 1 << 5 ) ) )
+        {
+            found |= CPU_AVX2;
+        }
+        if ( ( ( xcr0 & 0xe6 ) == 0xe6 ) && ( extended[1] & ( 1 << 16 ) ) &&
+             ( extended[1] & ( 1 << 30 ) ) )
+        {
+            found |= CPU_AVX512;
+            if ( extended[2] & ( 1 << 1 ) )
+            {
+                found |= CPU_VBMI;
+            }
+        }
+#elif defined( PBM_X86 )
+        // gcc and clang check the operating system support themselves.
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "sse2" ) )
+        {
+            found |= CPU_SSE2;
+        }
+        if ( __builtin_cpu_supports( "ssse3" ) )
+        {
+            found |= CPU_SSSE3;
+        }
+        if ( __builtin_cpu_supports( "avx2" ) )
+        {
+            found |= CPU_AVX2;
+        }
+        if ( __builtin_cpu_supports( "avx512f" ) &&
+             __builtin_cpu_supports( "avx512bw" ) )
+        {
+            found |= CPU_AVX512;
+            if ( __builtin_cpu_supports( "avx512vbmi" ) )
+            {
+                found |= CPU_VBMI;
+            }
+        }
+#endif
+        return found;
+    }();
+
+    return features;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Picks the kernels again using only the given instruction sets, or those of
+ * them the cpu has. Passing 0 selects the plain C++ versions. Call this
+ * before any other threads use the kernels.
+ *
+ * @param[in]  features - cpuFeature flags or'ed together.
+ *
+ * @par Example
+ * @verbatim
+   // useCpuFeatures( CPU_SSE2 | CPU_SSSE3 );
+   @endverbatim
+ *****************************************************************************/
+void useCpuFeatures( int features )
+{
+    active = selectKernels( features & cpuFeatures() );
+}
+
+
+
+/*******************************************************************************
+ *                         Plain C++ Kernels
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of addSaturate.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value added to each sample.
+ *
+ * @par Example
+ * @verbatim
+   // addSaturateScalar( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+static void addSaturateScalar( pixel* data, int count, pixel amount )
+{
+    int j;
+    int sum;
+
+    for ( j = 0; j < count; j++ )
+    {
+        sum = data[j] + amount;
+        data[j] = ( pixel ) ( ( sum > 255 ) ? 255 : sum );
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of subSaturate.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value subtracted from each sample.
+ *
+ * @par Example
+ * @verbatim
+   // subSaturateScalar( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+static void subSaturateScalar( pixel* data, int count, pixel amount )
+{
+    int j;
+    int difference;
+
+    for ( j = 0; j < count; j++ )
+    {
+        difference = data[j] - amount;
+        data[j] = ( pixel ) ( ( difference < 0 ) ? 0 : difference );
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of invertPixels.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // invertScalar( row, cols );
+   @endverbatim
+ *****************************************************************************/
+static void invertScalar( pixel* data, int count )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        data[j] = 255 - data[j];
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of fillPixels.
+ *
+ * @param[out] data - samples to set.
+ * @param[in]  count - number of samples.
+ * @param[in]  value - value to store.
+ *
+ * @par Example
+ * @verbatim
+   // fillScalar( row, cols, 0 );
+   @endverbatim
+ *****************************************************************************/
+static void fillScalar( pixel* data, int count, pixel value )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        data[j] = value;
+    }
+}
+
+
+
+/*******************************************************************************
+ *                         Deinterleave
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of deinterleaveRGB.
+ *
+ * @param[in]  src - interleaved samples, 3 per pixel.
+ * @param[out] red - where the red samples go.
+ * @param[out] green - where the green samples go.
+ * @param[out] blue - where the blue samples go.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // deinterleaveScalar( src, red, green, blue, cols );
+   @endverbatim
+ *****************************************************************************/
+static void deinterleaveScalar( const pixel* src, pixel* red, pixel* green,
+    pixel* blue, int count )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        red[j] = src[3 * j];
+        green[j] = src[3 * j + 1];
+        blue[j] = src[3 * j + 2];
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSSE3 version of deinterleaveRGB. Loads 48 bytes, 16 pixels, at a time and
+ * uses byte shuffles to gather each color out of the three loads, then ors
+ * the pieces together. Leftover pixels are done by the plain version.
+ *
+ * @param[in]  src - interleaved samples, 3 per pixel.
+ * @param[out] red - where the red samples go.
+ * @param[out] green - where the green samples go.
+ * @param[out] blue - where the blue samples go.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // deinterleaveSSSE3( src, red, green, blue, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSSE3 static void deinterleaveSSSE3( const pixel* src, pixel* red,
+    pixel* green, pixel* blue, int count )
+{
+    static const struct shuffleMasks
+    {
+        alignas( 16 ) signed char mask[3][3][16]; /**< [color][load][byte] */
+
+        shuffleMasks()
+        {
+            int color;
+            int load;
+            int k;
+            int index;
+
+            // Byte k of a color comes from sample 3k + color, which is in
+            // load ( 3k + color ) / 16. Zero it out of the other two loads.
+            for ( color = 0; color < 3; color++ )
+            {
+                for ( load = 0; load < 3; load++ )
+                {
+                    for ( k = 0; k < 16; k++ )
+                    {
+                        index = 3 * k + color;
+                        mask[color][load][k] = ( index / 16 == load ) ?
+                            ( signed char ) ( index % 16 ) : ( signed char ) 0x80;
+                    }
+                }
+            }
+        }
+    } masks;
+
+    int j;
+    int color;
+    __m128i in[3];
+    __m128i out;
+    pixel* planes[3] = { red, green, blue };
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        in[0] = _mm_loadu_si128( ( const __m128i* ) ( src + 3 * j ) );
+        in[1] = _mm_loadu_si128( ( const __m128i* ) ( src + 3 * j + 16 ) );
+        in[2] = _mm_loadu_si128( ( const __m128i* ) ( src + 3 * j + 32 ) );
+
+        for ( color = 0; color < 3; color++ )
+        {
+            out = _mm_or_si128( _mm_or_si128(
+                _mm_shuffle_epi8( in[0], _mm_load_si128( ( const __m128i* ) masks.mask[color][0] ) ),
+                _mm_shuffle_epi8( in[1], _mm_load_si128( ( const __m128i* ) masks.mask[color][1] ) ) ),
+                _mm_shuffle_epi8( in[2], _mm_load_si128( ( const __m128i* ) masks.mask[color][2] ) ) );
+            _mm_storeu_si128( ( __m128i* ) ( planes[color] + j ), out );
+        }
+    }
+
+    deinterleaveScalar( src + 3 * j, red + j, green + j, blue + j, count - j );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Interleave
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of interleaveRGB.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] dest - where the interleaved samples go, 3 per pixel.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // interleaveScalar( red, green, blue, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+static void interleaveScalar( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* dest, int count )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        dest[3 * j] = red[j];
+        dest[3 * j + 1] = green[j];
+        dest[3 * j + 2] = blue[j];
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSSE3 version of interleaveRGB. Loads 16 pixels of each color and uses byte
+ * shuffles to place them into three 16 byte stores, the reverse of
+ * deinterleaveSSSE3. Leftover pixels are done by the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] dest - where the interleaved samples go, 3 per pixel.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // interleaveSSSE3( red, green, blue, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSSE3 static void interleaveSSSE3( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* dest, int count )
+{
+    static const struct shuffleMasks
+    {
+        alignas( 16 ) signed char mask[3][3][16]; /**< [store][color][byte] */
+
+        shuffleMasks()
+        {
+            int store;
+            int color;
+            int k;
+            int index;
+
+            // Byte k of a store is sample 16 * store + k, which is color
+            // index % 3 of pixel index / 3.
+            for ( store = 0; store < 3; store++ )
+            {
+                for ( color = 0; color < 3; color++ )
+                {
+                    for ( k = 0; k < 16; k++ )
+                    {
+                        index = 16 * store + k;
+                        mask[store][color][k] = ( index % 3 == color ) ?
+                            ( signed char ) ( index / 3 ) : ( signed char ) 0x80;
+                    }
+                }
+            }
+        }
+    } masks;
+
+    int j;
+    int store;
+    __m128i in[3];
+    __m128i out;
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        in[0] = _mm_loadu_si128( ( const __m128i* ) ( red + j ) );
+        in[1] = _mm_loadu_si128( ( const __m128i* ) ( green + j ) );
+        in[2] = _mm_loadu_si128( ( const __m128i* ) ( blue + j ) );
+
+        for ( store = 0; store < 3; store++ )
+        {
+            out = _mm_or_si128( _mm_or_si128(
+                _mm_shuffle_epi8( in[0], _mm_load_si128( ( const __m128i* ) masks.mask[store][0] ) ),
+                _mm_shuffle_epi8( in[1], _mm_load_si128( ( const __m128i* ) masks.mask[store][1] ) ) ),
+                _mm_shuffle_epi8( in[2], _mm_load_si128( ( const __m128i* ) masks.mask[store][2] ) ) );
+            _mm_storeu_si128( ( __m128i* ) ( dest + 3 * j + 16 * store ), out );
+        }
+    }
+
+    interleaveScalar( red + j, green + j, blue + j, dest + 3 * j, count - j );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Grayscale
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of grayscaleFixed. ( 3r + 6g + b ) is at most 2550, and
+ * for every value that small multiplying by 6554 and shifting right 16 is
+ * the same as dividing by 10.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleFixedScalar( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+static void grayscaleFixedScalar( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    unsigned int sum;
+
+    for ( j = 0; j < count; j++ )
+    {
+        sum = 3u * red[j] + 6u * green[j] + blue[j];
+        gray[j] = ( pixel ) ( ( sum * GRAY_RECIPROCAL ) >> 16 );
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of grayscaleExact, the double precision formula the
+ * program has always used.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleExactScalar( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+static void grayscaleExactScalar( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        gray[j] = ( pixel ) ( ( .3 * red[j] ) + ( .6 * green[j] ) + ( .1 * blue[j] ) );
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of grayscaleFixed. Widens 16 pixels to 16 bit lanes, forms
+ * 3r + 6g + b with adds and divides by 10 with a high half multiply by 6554.
+ * Leftover pixels are done by the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleFixedSSE2( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void grayscaleFixedSSE2( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    int half;
+    __m128i zero = _mm_setzero_si128();
+    __m128i reciprocal = _mm_set1_epi16( ( short ) GRAY_RECIPROCAL );
+    __m128i r;
+    __m128i g;
+    __m128i b;
+    __m128i wide[3];
+    __m128i sum[2];
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        r = _mm_loadu_si128( ( const __m128i* ) ( red + j ) );
+        g = _mm_loadu_si128( ( const __m128i* ) ( green + j ) );
+        b = _mm_loadu_si128( ( const __m128i* ) ( blue + j ) );
+
+        for ( half = 0; half < 2; half++ )
+        {
+            wide[0] = half ? _mm_unpackhi_epi8( r, zero ) : _mm_unpacklo_epi8( r, zero );
+            wide[1] = half ? _mm_unpackhi_epi8( g, zero ) : _mm_unpacklo_epi8( g, zero );
+            wide[2] = half ? _mm_unpackhi_epi8( b, zero ) : _mm_unpacklo_epi8( b, zero );
+
+            // 3r + 6g + b, then the high half of times 6554 is divide by 10.
+            wide[1] = _mm_add_epi16( wide[0], _mm_add_epi16( wide[1], wide[1] ) );
+            sum[half] = _mm_add_epi16( _mm_add_epi16( wide[1], _mm_add_epi16( wide[1], wide[1] ) ),
+                wide[2] );
+            sum[half] = _mm_mulhi_epu16( sum[half], reciprocal );
+        }
+
+        _mm_storeu_si128( ( __m128i* ) ( gray + j ), _mm_packus_epi16( sum[0], sum[1] ) );
+    }
+
+    grayscaleFixedScalar( red + j, green + j, blue + j, gray + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of grayscaleExact. Does the same double precision multiplies
+ * and adds, in the same order, 2 pixels at a time and truncates like the
+ * cast does, so the results match bit for bit. Leftover pixels are done by
+ * the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleExactSSE2( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void grayscaleExactSSE2( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    int half;
+    int packed;
+    __m128i zero = _mm_setzero_si128();
+    __m128d redWeight = _mm_set1_pd( .3 );
+    __m128d greenWeight = _mm_set1_pd( .6 );
+    __m128d blueWeight = _mm_set1_pd( .1 );
+    __m128i wide[3];
+    __m128i result[2];
+    __m128d sum;
+
+    for ( j = 0; j + 4 <= count; j += 4 )
+    {
+        // Widen 4 samples of each color to 32 bits.
+        memcpy( &packed, red + j, 4 );
+        wide[0] = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( packed ), zero ), zero );
+        memcpy( &packed, green + j, 4 );
+        wide[1] = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( packed ), zero ), zero );
+        memcpy( &packed, blue + j, 4 );
+        wide[2] = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( packed ), zero ), zero );
+
+        for ( half = 0; half < 2; half++ )
+        {
+            sum = _mm_add_pd( _mm_add_pd(
+                _mm_mul_pd( redWeight, _mm_cvtepi32_pd( wide[0] ) ),
+                _mm_mul_pd( greenWeight, _mm_cvtepi32_pd( wide[1] ) ) ),
+                _mm_mul_pd( blueWeight, _mm_cvtepi32_pd( wide[2] ) ) );
+            result[half] = _mm_cvttpd_epi32( sum );
+
+            wide[0] = _mm_srli_si128( wide[0], 8 );
+            wide[1] = _mm_srli_si128( wide[1], 8 );
+            wide[2] = _mm_srli_si128( wide[2], 8 );
+        }
+
+        result[0] = _mm_unpacklo_epi64( result[0], result[1] );
+        result[0] = _mm_packs_epi32( result[0], result[0] );
+        packed = _mm_cvtsi128_si32( _mm_packus_epi16( result[0], result[0] ) );
+        memcpy( gray + j, &packed, 4 );
+    }
+
+    grayscaleExactScalar( red + j, green + j, blue + j, gray + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of grayscaleFixed, 32 pixels at a time. The unpacks and the
+ * pack both work inside each 128 bit half, so the pixels come back out in
+ * order. Leftover pixels are done by the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleFixedAVX2( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void grayscaleFixedAVX2( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    int half;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i reciprocal = _mm256_set1_epi16( ( short ) GRAY_RECIPROCAL );
+    __m256i r;
+    __m256i g;
+    __m256i b;
+    __m256i wide[3];
+    __m256i sum[2];
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        r = _mm256_loadu_si256( ( const __m256i* ) ( red + j ) );
+        g = _mm256_loadu_si256( ( const __m256i* ) ( green + j ) );
+        b = _mm256_loadu_si256( ( const __m256i* ) ( blue + j ) );
+
+        for ( half = 0; half < 2; half++ )
+        {
+            wide[0] = half ? _mm256_unpackhi_epi8( r, zero ) : _mm256_unpacklo_epi8( r, zero );
+            wide[1] = half ? _mm256_unpackhi_epi8( g, zero ) : _mm256_unpacklo_epi8( g, zero );
+            wide[2] = half ? _mm256_unpackhi_epi8( b, zero ) : _mm256_unpacklo_epi8( b, zero );
+
+            // 3r + 6g + b, then the high half of times 6554 is divide by 10.
+            wide[1] = _mm256_add_epi16( wide[0], _mm256_add_epi16( wide[1], wide[1] ) );
+            sum[half] = _mm256_add_epi16( _mm256_add_epi16( wide[1],
+                _mm256_add_epi16( wide[1], wide[1] ) ), wide[2] );
+            sum[half] = _mm256_mulhi_epu16( sum[half], reciprocal );
+        }
+
+        _mm256_storeu_si256( ( __m256i* ) ( gray + j ), _mm256_packus_epi16( sum[0], sum[1] ) );
+    }
+
+    grayscaleFixedScalar( red + j, green + j, blue + j, gray + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of grayscaleExact. Does the same double precision multiplies
+ * and adds as the plain version, 4 pixels to a register and 8 pixels at a
+ * time. Leftover pixels are done by the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleExactAVX2( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void grayscaleExactAVX2( const pixel* red, const pixel* green,
+    const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    int half;
+    __m256d redWeight = _mm256_set1_pd( .3 );
+    __m256d greenWeight = _mm256_set1_pd( .6 );
+    __m256d blueWeight = _mm256_set1_pd( .1 );
+    __m256i wide[3];
+    __m128i result[2];
+    __m256d sum;
+
+    for ( j = 0; j + 8 <= count; j += 8 )
+    {
+        // Widen 8 samples of each color to 32 bits.
+        wide[0] = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i* ) ( red + j ) ) );
+        wide[1] = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i* ) ( green + j ) ) );
+        wide[2] = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i* ) ( blue + j ) ) );
+
+        for ( half = 0; half < 2; half++ )
+        {
+            sum = _mm256_add_pd( _mm256_add_pd(
+                _mm256_mul_pd( redWeight, _mm256_cvtepi32_pd( half ?
+                    _mm256_extracti128_si256( wide[0], 1 ) : _mm256_castsi256_si128( wide[0] ) ) ),
+                _mm256_mul_pd( greenWeight, _mm256_cvtepi32_pd( half ?
+                    _mm256_extracti128_si256( wide[1], 1 ) : _mm256_castsi256_si128( wide[1] ) ) ) ),
+                _mm256_mul_pd( blueWeight, _mm256_cvtepi32_pd( half ?
+                    _mm256_extracti128_si256( wide[2], 1 ) : _mm256_castsi256_si128( wide[2] ) ) ) );
+            result[half] = _mm256_cvttpd_epi32( sum );
+        }
+
+        result[0] = _mm_packs_epi32( result[0], result[1] );
+        _mm_storel_epi64( ( __m128i* ) ( gray + j ), _mm_packus_epi16( result[0], result[0] ) );
+    }
+
+    grayscaleExactScalar( red + j, green + j, blue + j, gray + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of grayscaleFixed, 64 pixels at a time. Leftover pixels
+ * are done by the plain version.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleFixedAVX512( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void grayscaleFixedAVX512( const pixel* red,
+    const pixel* green, const pixel* blue, pixel* gray, int count )
+{
+    int j;
+    int half;
+    __m512i zero = _mm512_setzero_si512();
+    __m512i reciprocal = _mm512_set1_epi16( ( short ) GRAY_RECIPROCAL );
+    __m512i r;
+    __m512i g;
+    __m512i b;
+    __m512i wide[3];
+    __m512i sum[2];
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        r = _mm512_loadu_si512( ( const void* ) ( red + j ) );
+        g = _mm512_loadu_si512( ( const void* ) ( green + j ) );
+        b = _mm512_loadu_si512( ( const void* ) ( blue + j ) );
+
+        for ( half = 0; half < 2; half++ )
+        {
+            wide[0] = half ? _mm512_unpackhi_epi8( r, zero ) : _mm512_unpacklo_epi8( r, zero );
+            wide[1] = half ? _mm512_unpackhi_epi8( g, zero ) : _mm512_unpacklo_epi8( g, zero );
+            wide[2] = half ? _mm512_unpackhi_epi8( b, zero ) : _mm512_unpacklo_epi8( b, zero );
+
+            // 3r + 6g + b, then the high half of times 6554 is divide by 10.
+            wide[1] = _mm512_add_epi16( wide[0], _mm512_add_epi16( wide[1], wide[1] ) );
+            sum[half] = _mm512_add_epi16( _mm512_add_epi16( wide[1],
+                _mm512_add_epi16( wide[1], wide[1] ) ), wide[2] );
+            sum[half] = _mm512_mulhi_epu16( sum[half], reciprocal );
+        }
+
+        _mm512_storeu_si512( ( void* ) ( gray + j ), _mm512_packus_epi16( sum[0], sum[1] ) );
+    }
+
+    grayscaleFixedScalar( red + j, green + j, blue + j, gray + j, count - j );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Range and Lookup Tables
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of findRange.
+ *
+ * @param[in]     data - samples to look at.
+ * @param[in]     count - number of samples.
+ * @param[in,out] low - lowered to the smallest sample.
+ * @param[in,out] high - raised to the largest sample.
+ *
+ * @par Example
+ * @verbatim
+   // findRangeScalar( row, cols, low, high );
+   @endverbatim
+ *****************************************************************************/
+static void findRangeScalar( const pixel* data, int count, pixel& low,
+    pixel& high )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        if ( data[j] < low )
+        {
+            low = data[j];
+        }
+        if ( data[j] > high )
+        {
+            high = data[j];
+        }
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of applyLut.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     lut - 256 entry table, each sample becomes lut[sample].
+ *
+ * @par Example
+ * @verbatim
+   // applyLutScalar( row, cols, lut );
+   @endverbatim
+ *****************************************************************************/
+static void applyLutScalar( pixel* data, int count, const pixel* lut )
+{
+    int j;
+
+    for ( j = 0; j < count; j++ )
+    {
+        data[j] = lut[data[j]];
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of findRange. Keeps a running minimum and maximum of each of
+ * 16 byte lanes, then folds the lanes together at the end. Leftover samples
+ * are done by the plain version.
+ *
+ * @param[in]     data - samples to look at.
+ * @param[in]     count - number of samples.
+ * @param[in,out] low - lowered to the smallest sample.
+ * @param[in,out] high - raised to the largest sample.
+ *
+ * @par Example
+ * @verbatim
+   // findRangeSSE2( row, cols, low, high );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void findRangeSSE2( const pixel* data, int count,
+    pixel& low, pixel& high )
+{
+    int j;
+    int k;
+    __m128i block;
+    __m128i lows = _mm_set1_epi8( ( char ) low );
+    __m128i highs = _mm_set1_epi8( ( char ) high );
+    alignas( 16 ) pixel lanes[2][16];
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        block = _mm_loadu_si128( ( const __m128i* ) ( data + j ) );
+        lows = _mm_min_epu8( lows, block );
+        highs = _mm_max_epu8( highs, block );
+    }
+
+    _mm_store_si128( ( __m128i* ) lanes[0], lows );
+    _mm_store_si128( ( __m128i* ) lanes[1], highs );
+    for ( k = 0; k < 16; k++ )
+    {
+        if ( lanes[0][k] < low )
+        {
+            low = lanes[0][k];
+        }
+        if ( lanes[1][k] > high )
+        {
+            high = lanes[1][k];
+        }
+    }
+    findRangeScalar( data + j, count - j, low, high );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of findRange, 32 byte lanes at a time. Leftover samples are
+ * done by the plain version.
+ *
+ * @param[in]     data - samples to look at.
+ * @param[in]     count - number of samples.
+ * @param[in,out] low - lowered to the smallest sample.
+ * @param[in,out] high - raised to the largest sample.
+ *
+ * @par Example
+ * @verbatim
+   // findRangeAVX2( row, cols, low, high );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void findRangeAVX2( const pixel* data, int count,
+    pixel& low, pixel& high )
+{
+    int j;
+    int k;
+    __m256i block;
+    __m256i lows = _mm256_set1_epi8( ( char ) low );
+    __m256i highs = _mm256_set1_epi8( ( char ) high );
+    alignas( 32 ) pixel lanes[2][32];
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        block = _mm256_loadu_si256( ( const __m256i* ) ( data + j ) );
+        lows = _mm256_min_epu8( lows, block );
+        highs = _mm256_max_epu8( highs, block );
+    }
+
+    _mm256_store_si256( ( __m256i* ) lanes[0], lows );
+    _mm256_store_si256( ( __m256i* ) lanes[1], highs );
+    for ( k = 0; k < 32; k++ )
+    {
+        if ( lanes[0][k] < low )
+        {
+            low = lanes[0][k];
+        }
+        if ( lanes[1][k] > high )
+        {
+            high = lanes[1][k];
+        }
+    }
+    findRangeScalar( data + j, count - j, low, high );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of findRange, 64 byte lanes at a time. Leftover samples
+ * are done by the plain version.
+ *
+ * @param[in]     data - samples to look at.
+ * @param[in]     count - number of samples.
+ * @param[in,out] low - lowered to the smallest sample.
+ * @param[in,out] high - raised to the largest sample.
+ *
+ * @par Example
+ * @verbatim
+   // findRangeAVX512( row, cols, low, high );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void findRangeAVX512( const pixel* data, int count,
+    pixel& low, pixel& high )
+{
+    int j;
+    int k;
+    __m512i block;
+    __m512i lows = _mm512_set1_epi8( ( char ) low );
+    __m512i highs = _mm512_set1_epi8( ( char ) high );
+    alignas( 64 ) pixel lanes[2][64];
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        block = _mm512_loadu_si512( ( const void* ) ( data + j ) );
+        lows = _mm512_min_epu8( lows, block );
+        highs = _mm512_max_epu8( highs, block );
+    }
+
+    _mm512_store_si512( ( void* ) lanes[0], lows );
+    _mm512_store_si512( ( void* ) lanes[1], highs );
+    for ( k = 0; k < 64; k++ )
+    {
+        if ( lanes[0][k] < low )
+        {
+            low = lanes[0][k];
+        }
+        if ( lanes[1][k] > high )
+        {
+            high = lanes[1][k];
+        }
+    }
+    findRangeScalar( data + j, count - j, low, high );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 VBMI version of applyLut. The table is held in four registers.
+ * Two byte permutes look up 64 samples in the low and the high half of the
+ * table and the top bit of each sample picks which result to keep.
+ * Leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     lut - 256 entry table, each sample becomes lut[sample].
+ *
+ * @par Example
+ * @verbatim
+   // applyLutVBMI( row, cols, lut );
+   @endverbatim
+ *****************************************************************************/
+TARGET_VBMI static void applyLutVBMI( pixel* data, int count, const pixel* lut )
+{
+    int j;
+    __m512i table[4];
+    __m512i index;
+    __m512i lower;
+    __m512i upper;
+
+    table[0] = _mm512_loadu_si512( ( const void* ) lut );
+    table[1] = _mm512_loadu_si512( ( const void* ) ( lut + 64 ) );
+    table[2] = _mm512_loadu_si512( ( const void* ) ( lut + 128 ) );
+    table[3] = _mm512_loadu_si512( ( const void* ) ( lut + 192 ) );
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        index = _mm512_loadu_si512( ( const void* ) ( data + j ) );
+        lower = _mm512_permutex2var_epi8( table[0], index, table[1] );
+        upper = _mm512_permutex2var_epi8( table[2], index, table[3] );
+        _mm512_storeu_si512( ( void* ) ( data + j ),
+            _mm512_mask_blend_epi8( _mm512_movepi8_mask( index ), lower, upper ) );
+    }
+
+    applyLutScalar( data + j, count - j, lut );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         3x3 Stencils
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of sharpenRow.
+ *
+ * @param[in]  above - row above the one being sharpened.
+ * @param[in]  center - row being sharpened.
+ * @param[in]  below - row below the one being sharpened.
+ * @param[out] dest - sharpened row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // sharpenRowScalar( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+static void sharpenRowScalar( const pixel* above, const pixel* center,
+    const pixel* below, pixel* dest, int count )
+{
+    int j;
+    int value;
+
+    for ( j = 1; j < count - 1; j++ )
+    {
+        value = 5 * center[j] - above[j] - below[j] - center[j - 1]
+            - center[j + 1];
+        if ( value < 0 )
+        {
+            value = 0;
+        }
+        else if ( value > 255 )
+        {
+            value = 255;
+        }
+        dest[j] = ( pixel ) value;
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of smoothRow.
+ *
+ * @param[in]  above - row above the one being smoothed.
+ * @param[in]  center - row being smoothed.
+ * @param[in]  below - row below the one being smoothed.
+ * @param[out] dest - smoothed row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // smoothRowScalar( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+static void smoothRowScalar( const pixel* above, const pixel* center,
+    const pixel* below, pixel* dest, int count )
+{
+    int j;
+    unsigned int sum;
+
+    for ( j = 1; j < count - 1; j++ )
+    {
+        sum = above[j - 1] + above[j] + above[j + 1] + center[j - 1]
+            + center[j] + center[j + 1] + below[j - 1] + below[j]
+            + below[j + 1];
+        dest[j] = ( pixel ) ( ( sum * SMOOTH_RECIPROCAL ) >> 16 );
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of sharpenRow. Sixteen pixels are widened to 16 bit lanes
+ * and worked out without any branches, then packed back with saturation,
+ * which does the clamp to 0 and 255. Leftover pixels are done by the plain
+ * version.
+ *
+ * @param[in]  above - row above the one being sharpened.
+ * @param[in]  center - row being sharpened.
+ * @param[in]  below - row below the one being sharpened.
+ * @param[out] dest - sharpened row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // sharpenRowSSE2( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void sharpenRowSSE2( const pixel* above,
+    const pixel* center, const pixel* below, pixel* dest, int count )
+{
+    int j;
+    __m128i zero = _mm_setzero_si128();
+    __m128i five = _mm_set1_epi16( 5 );
+    __m128i middle;
+    __m128i around;
+    __m128i lows;
+    __m128i highs;
+
+    for ( j = 1; j + 16 < count; j += 16 )
+    {
+        middle = _mm_loadu_si128( ( const __m128i* ) ( center + j ) );
+        lows = _mm_mullo_epi16( _mm_unpacklo_epi8( middle, zero ), five );
+        highs = _mm_mullo_epi16( _mm_unpackhi_epi8( middle, zero ), five );
+
+        // Take away the four neighbors one at a time.
+        around = _mm_loadu_si128( ( const __m128i* ) ( above + j ) );
+        lows = _mm_sub_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+        highs = _mm_sub_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+        around = _mm_loadu_si128( ( const __m128i* ) ( below + j ) );
+        lows = _mm_sub_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+        highs = _mm_sub_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+        around = _mm_loadu_si128( ( const __m128i* ) ( center + j - 1 ) );
+        lows = _mm_sub_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+        highs = _mm_sub_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+        around = _mm_loadu_si128( ( const __m128i* ) ( center + j + 1 ) );
+        lows = _mm_sub_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+        highs = _mm_sub_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+
+        _mm_storeu_si128( ( __m128i* ) ( dest + j ),
+            _mm_packus_epi16( lows, highs ) );
+    }
+
+    sharpenRowScalar( above + j - 1, center + j - 1, below + j - 1,
+        dest + j - 1, count - j + 1 );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of smoothRow. Sixteen pixels are widened to 16 bit lanes, the
+ * nine values are added up and the divide by 9 is done as a multiply by
+ * SMOOTH_RECIPROCAL keeping the high 16 bits. Leftover pixels are done
+ * by the plain version.
+ *
+ * @param[in]  above - row above the one being smoothed.
+ * @param[in]  center - row being smoothed.
+ * @param[in]  below - row below the one being smoothed.
+ * @param[out] dest - smoothed row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // smoothRowSSE2( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void smoothRowSSE2( const pixel* above,
+    const pixel* center, const pixel* below, pixel* dest, int count )
+{
+    int j;
+    int k;
+    __m128i zero = _mm_setzero_si128();
+    __m128i ninth = _mm_set1_epi16( ( short ) SMOOTH_RECIPROCAL );
+    __m128i around;
+    __m128i lows;
+    __m128i highs;
+    const pixel* lines[3] = { above, center, below };
+
+    for ( j = 1; j + 16 < count; j += 16 )
+    {
+        lows = zero;
+        highs = zero;
+        for ( k = 0; k < 3; k++ )
+        {
+            around = _mm_loadu_si128( ( const __m128i* ) ( lines[k] + j - 1 ) );
+            lows = _mm_add_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+            highs = _mm_add_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+            around = _mm_loadu_si128( ( const __m128i* ) ( lines[k] + j ) );
+            lows = _mm_add_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+            highs = _mm_add_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+            around = _mm_loadu_si128( ( const __m128i* ) ( lines[k] + j + 1 ) );
+            lows = _mm_add_epi16( lows, _mm_unpacklo_epi8( around, zero ) );
+            highs = _mm_add_epi16( highs, _mm_unpackhi_epi8( around, zero ) );
+        }
+        lows = _mm_mulhi_epu16( lows, ninth );
+        highs = _mm_mulhi_epu16( highs, ninth );
+        _mm_storeu_si128( ( __m128i* ) ( dest + j ),
+            _mm_packus_epi16( lows, highs ) );
+    }
+
+    smoothRowScalar( above + j - 1, center + j - 1, below + j - 1,
+        dest + j - 1, count - j + 1 );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of sharpenRow, the same as the SSE2 version with 32 pixels
+ * at a time. The unpacks and the pack both work inside each 128 bit half,
+ * so the pixels come back out in order. Leftover pixels are done by the
+ * plain version.
+ *
+ * @param[in]  above - row above the one being sharpened.
+ * @param[in]  center - row being sharpened.
+ * @param[in]  below - row below the one being sharpened.
+ * @param[out] dest - sharpened row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // sharpenRowAVX2( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void sharpenRowAVX2( const pixel* above,
+    const pixel* center, const pixel* below, pixel* dest, int count )
+{
+    int j;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i five = _mm256_set1_epi16( 5 );
+    __m256i middle;
+    __m256i around;
+    __m256i lows;
+    __m256i highs;
+
+    for ( j = 1; j + 32 < count; j += 32 )
+    {
+        middle = _mm256_loadu_si256( ( const __m256i* ) ( center + j ) );
+        lows = _mm256_mullo_epi16( _mm256_unpacklo_epi8( middle, zero ), five );
+        highs = _mm256_mullo_epi16( _mm256_unpackhi_epi8( middle, zero ), five );
+
+        // Take away the four neighbors one at a time.
+        around = _mm256_loadu_si256( ( const __m256i* ) ( above + j ) );
+        lows = _mm256_sub_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+        highs = _mm256_sub_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+        around = _mm256_loadu_si256( ( const __m256i* ) ( below + j ) );
+        lows = _mm256_sub_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+        highs = _mm256_sub_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+        around = _mm256_loadu_si256( ( const __m256i* ) ( center + j - 1 ) );
+        lows = _mm256_sub_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+        highs = _mm256_sub_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+        around = _mm256_loadu_si256( ( const __m256i* ) ( center + j + 1 ) );
+        lows = _mm256_sub_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+        highs = _mm256_sub_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+
+        _mm256_storeu_si256( ( __m256i* ) ( dest + j ),
+            _mm256_packus_epi16( lows, highs ) );
+    }
+
+    sharpenRowScalar( above + j - 1, center + j - 1, below + j - 1,
+        dest + j - 1, count - j + 1 );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of smoothRow, the same as the SSE2 version with 32 pixels
+ * at a time. The unpacks and the pack both work inside each 128 bit half,
+ * so the pixels come back out in order. Leftover pixels are done by the
+ * plain version.
+ *
+ * @param[in]  above - row above the one being smoothed.
+ * @param[in]  center - row being smoothed.
+ * @param[in]  below - row below the one being smoothed.
+ * @param[out] dest - smoothed row.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // smoothRowAVX2( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void smoothRowAVX2( const pixel* above,
+    const pixel* center, const pixel* below, pixel* dest, int count )
+{
+    int j;
+    int k;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i ninth = _mm256_set1_epi16( ( short ) SMOOTH_RECIPROCAL );
+    __m256i around;
+    __m256i lows;
+    __m256i highs;
+    const pixel* lines[3] = { above, center, below };
+
+    for ( j = 1; j + 32 < count; j += 32 )
+    {
+        lows = zero;
+        highs = zero;
+        for ( k = 0; k < 3; k++ )
+        {
+            around = _mm256_loadu_si256( ( const __m256i* ) ( lines[k] + j - 1 ) );
+            lows = _mm256_add_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+            highs = _mm256_add_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+            around = _mm256_loadu_si256( ( const __m256i* ) ( lines[k] + j ) );
+            lows = _mm256_add_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+            highs = _mm256_add_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+            around = _mm256_loadu_si256( ( const __m256i* ) ( lines[k] + j + 1 ) );
+            lows = _mm256_add_epi16( lows, _mm256_unpacklo_epi8( around, zero ) );
+            highs = _mm256_add_epi16( highs, _mm256_unpackhi_epi8( around, zero ) );
+        }
+        lows = _mm256_mulhi_epu16( lows, ninth );
+        highs = _mm256_mulhi_epu16( highs, ninth );
+        _mm256_storeu_si256( ( __m256i* ) ( dest + j ),
+            _mm256_packus_epi16( lows, highs ) );
+    }
+
+    smoothRowScalar( above + j - 1, center + j - 1, below + j - 1,
+        dest + j - 1, count - j + 1 );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Transpose
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of transposeTile.
+ *
+ * @param[in]  src - first pixel of the tile.
+ * @param[in]  srcStride - distance between two source rows, may be negative.
+ * @param[out] dest - where the first pixel of the tile goes.
+ * @param[in]  destStride - distance between two dest rows, may be negative.
+ * @param[in]  height - number of rows in the tile.
+ * @param[in]  width - number of columns in the tile.
+ *
+ * @par Example
+ * @verbatim
+   // transposeTileScalar( src, stride, dest, stride, 64, 64 );
+   @endverbatim
+ *****************************************************************************/
+static void transposeTileScalar( const pixel* src, ptrdiff_t srcStride,
+    pixel* dest, ptrdiff_t destStride, int height, int width )
+{
+    int i;
+    int j;
+
+    for ( i = 0; i < height; i++ )
+    {
+        for ( j = 0; j < width; j++ )
+        {
+            dest[j * destStride + i] = src[i * srcStride + j];
+        }
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of transposeTile. The tile is done in 16x16 blocks, each one
+ * loaded as 16 rows and transposed in registers with four rounds of
+ * unpacks, bytes, then pairs, then fours, then eights. The unpacks leave the
+ * columns in bit reversed order, so each is stored to the dest row it really
+ * belongs to. Pixels left over at the right and bottom are done by the plain
+ * version.
+ *
+ * @param[in]  src - first pixel of the tile.
+ * @param[in]  srcStride - distance between two source rows, may be negative.
+ * @param[out] dest - where the first pixel of the tile goes.
+ * @param[in]  destStride - distance between two dest rows, may be negative.
+ * @param[in]  height - number of rows in the tile.
+ * @param[in]  width - number of columns in the tile.
+ *
+ * @par Example
+ * @verbatim
+   // transposeTileSSE2( src, stride, dest, stride, 64, 64 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void transposeTileSSE2( const pixel* src,
+    ptrdiff_t srcStride, pixel* dest, ptrdiff_t destStride, int height,
+    int width )
+{
+    int i;
+    int j;
+    int k;
+    __m128i a[16];
+    __m128i b[16];
+    static const int column[16] = { 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13,
+        3, 11, 7, 15 };
+
+    for ( i = 0; i + 16 <= height; i += 16 )
+    {
+        for ( j = 0; j + 16 <= width; j += 16 )
+        {
+            for ( k = 0; k < 16; k++ )
+            {
+                a[k] = _mm_loadu_si128( ( const __m128i* ) ( src +
+                    ( i + k ) * srcStride + j ) );
+            }
+            for ( k = 0; k < 8; k++ )
+            {
+                b[k] = _mm_unpacklo_epi8( a[2 * k], a[2 * k + 1] );
+                b[k + 8] = _mm_unpackhi_epi8( a[2 * k], a[2 * k + 1] );
+            }
+            for ( k = 0; k < 8; k++ )
+            {
+                a[k] = _mm_unpacklo_epi16( b[2 * k], b[2 * k + 1] );
+                a[k + 8] = _mm_unpackhi_epi16( b[2 * k], b[2 * k + 1] );
+            }
+            for ( k = 0; k < 8; k++ )
+            {
+                b[k] = _mm_unpacklo_epi32( a[2 * k], a[2 * k + 1] );
+                b[k + 8] = _mm_unpackhi_epi32( a[2 * k], a[2 * k + 1] );
+            }
+            for ( k = 0; k < 8; k++ )
+            {
+                a[k] = _mm_unpacklo_epi64( b[2 * k], b[2 * k + 1] );
+                a[k + 8] = _mm_unpackhi_epi64( b[2 * k], b[2 * k + 1] );
+            }
+            for ( k = 0; k < 16; k++ )
+            {
+                _mm_storeu_si128( ( __m128i* ) ( dest + ( j + column[k] ) *
+                    destStride + i ), a[k] );
+            }
+        }
+
+        // Columns left over on the right.
+        transposeTileScalar( src + i * srcStride + j, srcStride,
+            dest + j * destStride + i, destStride, 16, width - j );
+    }
+
+    // Rows left over at the bottom.
+    transposeTileScalar( src + i * srcStride, srcStride, dest + i,
+        destStride, height - i, width );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Reverse
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Plain C++ version of reversePixels.
+ *
+ * @param[in,out] data - samples to reverse.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // reverseScalar( row, cols );
+   @endverbatim
+ *****************************************************************************/
+static void reverseScalar( pixel* data, int count )
+{
+    int j;
+
+    for ( j = 0; j < count / 2; j++ )
+    {
+        swap( data[j], data[count - 1 - j] );
+    }
+}
+
+
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSSE3 version of reversePixels. Takes 16 bytes from each end at a time,
+ * reverses both with a byte shuffle, and stores each at the other end. The
+ * samples left in the middle are done by the plain version.
+ *
+ * @param[in,out] data - samples to reverse.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // reverseSSSE3( row, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSSE3 static void reverseSSSE3( pixel* data, int count )
+{
+    int j;
+    __m128i left;
+    __m128i right;
+    __m128i order = _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+        3, 2, 1, 0 );
+
+    for ( j = 0; 2 * ( j + 16 ) <= count; j += 16 )
+    {
+        left = _mm_loadu_si128( ( const __m128i* ) ( data + j ) );
+        right = _mm_loadu_si128( ( const __m128i* ) ( data + count - 16 - j ) );
+        _mm_storeu_si128( ( __m128i* ) ( data + j ),
+            _mm_shuffle_epi8( right, order ) );
+        _mm_storeu_si128( ( __m128i* ) ( data + count - 16 - j ),
+            _mm_shuffle_epi8( left, order ) );
+    }
+
+    reverseScalar( data + j, count - 2 * j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of reversePixels, 32 bytes from each end at a time. The byte
+ * shuffle only reverses inside each 128 bit half, so the halves are swapped
+ * afterwards. The samples left in the middle are done by the SSSE3 version.
+ *
+ * @param[in,out] data - samples to reverse.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // reverseAVX2( row, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void reverseAVX2( pixel* data, int count )
+{
+    int j;
+    __m256i left;
+    __m256i right;
+    __m256i order = _mm256_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5,
+        4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 );
+
+    for ( j = 0; 2 * ( j + 32 ) <= count; j += 32 )
+    {
+        left = _mm256_loadu_si256( ( const __m256i* ) ( data + j ) );
+        right = _mm256_loadu_si256( ( const __m256i* )
+            ( data + count - 32 - j ) );
+        left = _mm256_permute4x64_epi64( _mm256_shuffle_epi8( left, order ),
+            0x4e );
+        right = _mm256_permute4x64_epi64( _mm256_shuffle_epi8( right, order ),
+            0x4e );
+        _mm256_storeu_si256( ( __m256i* ) ( data + j ), right );
+        _mm256_storeu_si256( ( __m256i* ) ( data + count - 32 - j ), left );
+    }
+
+    reverseSSSE3( data + j, count - 2 * j );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         SSE2 Kernels
+ ******************************************************************************/
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of addSaturate. Adds 16 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value added to each sample.
+ *
+ * @par Example
+ * @verbatim
+   // addSaturateSSE2( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void addSaturateSSE2( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m128i block;
+    __m128i step = _mm_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        block = _mm_loadu_si128( ( const __m128i* ) ( data + j ) );
+        _mm_storeu_si128( ( __m128i* ) ( data + j ), _mm_adds_epu8( block, step ) );
+    }
+
+    addSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of subSaturate. Subtracts 16 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value subtracted from each sample.
+ *
+ * @par Example
+ * @verbatim
+   // subSaturateSSE2( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void subSaturateSSE2( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m128i block;
+    __m128i step = _mm_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        block = _mm_loadu_si128( ( const __m128i* ) ( data + j ) );
+        _mm_storeu_si128( ( __m128i* ) ( data + j ), _mm_subs_epu8( block, step ) );
+    }
+
+    subSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of invertPixels. Flips all the bits of 16 samples at a time,
+ * which is the same as subtracting them from 255. Leftover samples are
+ * done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // invertSSE2( row, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void invertSSE2( pixel* data, int count )
+{
+    int j;
+    __m128i block;
+    __m128i ones = _mm_set1_epi8( ( char ) 0xff );
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        block = _mm_loadu_si128( ( const __m128i* ) ( data + j ) );
+        _mm_storeu_si128( ( __m128i* ) ( data + j ), _mm_xor_si128( block, ones ) );
+    }
+
+    invertScalar( data + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * SSE2 version of fillPixels. Stores 16 samples at a time, leftover samples
+ * are done by the plain version.
+ *
+ * @param[out] data - samples to set.
+ * @param[in]  count - number of samples.
+ * @param[in]  value - value to store.
+ *
+ * @par Example
+ * @verbatim
+   // fillSSE2( row, cols, 0 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_SSE2 static void fillSSE2( pixel* data, int count, pixel value )
+{
+    int j;
+    __m128i fillValue = _mm_set1_epi8( ( char ) value );
+
+    for ( j = 0; j + 16 <= count; j += 16 )
+    {
+        _mm_storeu_si128( ( __m128i* ) ( data + j ), fillValue );
+    }
+
+    fillScalar( data + j, count - j, value );
+}
+#endif
+
+
+
+
+/*******************************************************************************
+ *                         AVX2 Kernels
+ ******************************************************************************/
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of addSaturate. Adds 32 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value added to each sample.
+ *
+ * @par Example
+ * @verbatim
+   // addSaturateAVX2( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void addSaturateAVX2( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m256i block;
+    __m256i step = _mm256_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        block = _mm256_loadu_si256( ( const __m256i* ) ( data + j ) );
+        _mm256_storeu_si256( ( __m256i* ) ( data + j ), _mm256_adds_epu8( block, step ) );
+    }
+
+    addSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of subSaturate. Subtracts 32 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value subtracted from each sample.
+ *
+ * @par Example
+ * @verbatim
+   // subSaturateAVX2( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void subSaturateAVX2( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m256i block;
+    __m256i step = _mm256_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        block = _mm256_loadu_si256( ( const __m256i* ) ( data + j ) );
+        _mm256_storeu_si256( ( __m256i* ) ( data + j ), _mm256_subs_epu8( block, step ) );
+    }
+
+    subSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of invertPixels. Flips all the bits of 32 samples at a time,
+ * which is the same as subtracting them from 255. Leftover samples are
+ * done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // invertAVX2( row, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void invertAVX2( pixel* data, int count )
+{
+    int j;
+    __m256i block;
+    __m256i ones = _mm256_set1_epi8( ( char ) 0xff );
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        block = _mm256_loadu_si256( ( const __m256i* ) ( data + j ) );
+        _mm256_storeu_si256( ( __m256i* ) ( data + j ), _mm256_xor_si256( block, ones ) );
+    }
+
+    invertScalar( data + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX2 version of fillPixels. Stores 32 samples at a time, leftover samples
+ * are done by the plain version.
+ *
+ * @param[out] data - samples to set.
+ * @param[in]  count - number of samples.
+ * @param[in]  value - value to store.
+ *
+ * @par Example
+ * @verbatim
+   // fillAVX2( row, cols, 0 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX2 static void fillAVX2( pixel* data, int count, pixel value )
+{
+    int j;
+    __m256i fillValue = _mm256_set1_epi8( ( char ) value );
+
+    for ( j = 0; j + 32 <= count; j += 32 )
+    {
+        _mm256_storeu_si256( ( __m256i* ) ( data + j ), fillValue );
+    }
+
+    fillScalar( data + j, count - j, value );
+}
+#endif
+
+
+
+
+/*******************************************************************************
+ *                         AVX-512 Kernels
+ ******************************************************************************/
+
+#ifdef PBM_X86
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of addSaturate. Adds 64 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value added to each sample.
+ *
+ * @par Example
+ * @verbatim
+   // addSaturateAVX512( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void addSaturateAVX512( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m512i block;
+    __m512i step = _mm512_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        block = _mm512_loadu_si512( ( const void* ) ( data + j ) );
+        _mm512_storeu_si512( ( void* ) ( data + j ), _mm512_adds_epu8( block, step ) );
+    }
+
+    addSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of subSaturate. Subtracts 64 samples at a time with the
+ * saturating instruction, leftover samples are done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value subtracted from each sample.
+ *
+ * @par Example
+ * @verbatim
+   // subSaturateAVX512( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void subSaturateAVX512( pixel* data, int count, pixel amount )
+{
+    int j;
+    __m512i block;
+    __m512i step = _mm512_set1_epi8( ( char ) amount );
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        block = _mm512_loadu_si512( ( const void* ) ( data + j ) );
+        _mm512_storeu_si512( ( void* ) ( data + j ), _mm512_subs_epu8( block, step ) );
+    }
+
+    subSaturateScalar( data + j, count - j, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of invertPixels. Flips all the bits of 64 samples at a time,
+ * which is the same as subtracting them from 255. Leftover samples are
+ * done by the plain version.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // invertAVX512( row, cols );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void invertAVX512( pixel* data, int count )
+{
+    int j;
+    __m512i block;
+    __m512i ones = _mm512_set1_epi8( ( char ) 0xff );
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        block = _mm512_loadu_si512( ( const void* ) ( data + j ) );
+        _mm512_storeu_si512( ( void* ) ( data + j ), _mm512_xor_si512( block, ones ) );
+    }
+
+    invertScalar( data + j, count - j );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * AVX-512 version of fillPixels. Stores 64 samples at a time, leftover samples
+ * are done by the plain version.
+ *
+ * @param[out] data - samples to set.
+ * @param[in]  count - number of samples.
+ * @param[in]  value - value to store.
+ *
+ * @par Example
+ * @verbatim
+   // fillAVX512( row, cols, 0 );
+   @endverbatim
+ *****************************************************************************/
+TARGET_AVX512 static void fillAVX512( pixel* data, int count, pixel value )
+{
+    int j;
+    __m512i fillValue = _mm512_set1_epi8( ( char ) value );
+
+    for ( j = 0; j + 64 <= count; j += 64 )
+    {
+        _mm512_storeu_si512( ( void* ) ( data + j ), fillValue );
+    }
+
+    fillScalar( data + j, count - j, value );
+}
+#endif
+
+
+
+/*******************************************************************************
+ *                         Dispatch
+ ******************************************************************************/
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Fills a table with the fastest version of each kernel that the given
+ * instruction sets allow.
+ *
+ * @param[in]  features - cpuFeature flags or'ed together.
+ *
+ * @returns the table of kernels.
+ *
+ * @par Example
+ * @verbatim
+   // active = selectKernels( cpuFeatures() );
+   @endverbatim
+ *****************************************************************************/
+static pixelKernels selectKernels( int features )
+{
+    pixelKernels table;
+
+    table.addSaturate = addSaturateScalar;
+    table.subSaturate = subSaturateScalar;
+    table.invertPixels = invertScalar;
+    table.fillPixels = fillScalar;
+    table.deinterleave = deinterleaveScalar;
+    table.interleave = interleaveScalar;
+    table.grayFixed = grayscaleFixedScalar;
+    table.grayExact = grayscaleExactScalar;
+    table.findRange = findRangeScalar;
+    table.applyLut = applyLutScalar;
+    table.sharpenRow = sharpenRowScalar;
+    table.smoothRow = smoothRowScalar;
+    table.transposeTile = transposeTileScalar;
+    table.reversePixels = reverseScalar;
+
+#ifdef PBM_X86
+    if ( features & CPU_SSE2 )
+    {
+        table.addSaturate = addSaturateSSE2;
+        table.subSaturate = subSaturateSSE2;
+        table.invertPixels = invertSSE2;
+        table.fillPixels = fillSSE2;
+        table.grayFixed = grayscaleFixedSSE2;
+        table.grayExact = grayscaleExactSSE2;
+        table.findRange = findRangeSSE2;
+        table.sharpenRow = sharpenRowSSE2;
+        table.smoothRow = smoothRowSSE2;
+        table.transposeTile = transposeTileSSE2;
+    }
+    if ( features & CPU_SSSE3 )
+    {
+        table.deinterleave = deinterleaveSSSE3;
+        table.interleave = interleaveSSSE3;
+        table.reversePixels = reverseSSSE3;
+    }
+    if ( features & CPU_AVX2 )
+    {
+        table.addSaturate = addSaturateAVX2;
+        table.subSaturate = subSaturateAVX2;
+        table.invertPixels = invertAVX2;
+        table.fillPixels = fillAVX2;
+        table.grayFixed = grayscaleFixedAVX2;
+        table.grayExact = grayscaleExactAVX2;
+        table.findRange = findRangeAVX2;
+        table.sharpenRow = sharpenRowAVX2;
+        table.smoothRow = smoothRowAVX2;
+        table.reversePixels = reverseAVX2;
+    }
+    if ( features & CPU_AVX512 )
+    {
+        table.addSaturate = addSaturateAVX512;
+        table.subSaturate = subSaturateAVX512;
+        table.invertPixels = invertAVX512;
+        table.fillPixels = fillAVX512;
+        table.grayFixed = grayscaleFixedAVX512;
+        table.findRange = findRangeAVX512;
+    }
+    if ( ( features & CPU_AVX512 ) && ( features & CPU_VBMI ) )
+    {
+        table.applyLut = applyLutVBMI;
+    }
+#endif
+
+    return table;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Adds an amount to each sample, stopping at 255.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value added to each sample.
+ *
+ * @par Example
+ * @verbatim
+   // addSaturate( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+void addSaturate( pixel* data, int count, pixel amount )
+{
+    active.addSaturate( data, count, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Replaces each sample with its entry in a 256 entry lookup table.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     lut - 256 entry table, each sample becomes lut[sample].
+ *
+ * @par Example
+ * @verbatim
+   // applyLut( row, cols, lut );
+   @endverbatim
+ *****************************************************************************/
+void applyLut( pixel* data, int count, const pixel* lut )
+{
+    active.applyLut( data, count, lut );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Splits a run of interleaved red, green, blue samples into the three color
+ * planes.
+ *
+ * @param[in]  src - interleaved samples, 3 per pixel.
+ * @param[out] red - where the red samples go.
+ * @param[out] green - where the green samples go.
+ * @param[out] blue - where the blue samples go.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // deinterleaveRGB( src, red, green, blue, cols );
+   @endverbatim
+ *****************************************************************************/
+void deinterleaveRGB( const pixel* src, pixel* red, pixel* green, pixel* blue,
+    int count )
+{
+    active.deinterleave( src, red, green, blue, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets each sample to a value.
+ *
+ * @param[out] data - samples to set.
+ * @param[in]  count - number of samples.
+ * @param[in]  value - value to store.
+ *
+ * @par Example
+ * @verbatim
+   // fillPixels( row, cols, 0 );
+   @endverbatim
+ *****************************************************************************/
+void fillPixels( pixel* data, int count, pixel value )
+{
+    active.fillPixels( data, count, value );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Finds the smallest and largest of a run of samples. low and high are only
+ * moved outwards, so a range can be built up over several calls by starting
+ * with low at 255 and high at 0.
+ *
+ * @param[in]     data - samples to look at.
+ * @param[in]     count - number of samples.
+ * @param[in,out] low - lowered to the smallest sample.
+ * @param[in,out] high - raised to the largest sample.
+ *
+ * @par Example
+ * @verbatim
+   // findRange( row, cols, low, high );
+   @endverbatim
+ *****************************************************************************/
+void findRange( const pixel* data, int count, pixel& low, pixel& high )
+{
+    active.findRange( data, count, low, high );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Converts pixels to gray with the same double precision formula the program
+ * has always used, ( pixel ) ( .3r + .6g + .1b ), so the results match the
+ * old output bit for bit.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleExact( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+void grayscaleExact( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* gray, int count )
+{
+    active.grayExact( red, green, blue, gray, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Converts pixels to gray in fixed point. Each gray value is
+ * ( 3r + 6g + b ) / 10 rounded down, the exact value of .3r + .6g + .1b
+ * rounded down. The double precision formula sometimes lands just under a
+ * whole number and gives one less, see grayscaleExact.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] gray - where the gray samples go, may be red.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // grayscaleFixed( red, green, blue, red, cols );
+   @endverbatim
+ *****************************************************************************/
+void grayscaleFixed( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* gray, int count )
+{
+    active.grayFixed( red, green, blue, gray, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Merges three color planes into a run of interleaved red, green, blue
+ * samples.
+ *
+ * @param[in]  red - red samples.
+ * @param[in]  green - green samples.
+ * @param[in]  blue - blue samples.
+ * @param[out] dest - where the interleaved samples go, 3 per pixel.
+ * @param[in]  count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   // interleaveRGB( red, green, blue, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+void interleaveRGB( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* dest, int count )
+{
+    active.interleave( red, green, blue, dest, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Replaces each sample with 255 minus the sample.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // invertPixels( row, cols );
+   @endverbatim
+ *****************************************************************************/
+void invertPixels( pixel* data, int count )
+{
+    active.invertPixels( data, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Reverses the order of a run of samples in place.
+ *
+ * @param[in,out] data - samples to reverse.
+ * @param[in]     count - number of samples.
+ *
+ * @par Example
+ * @verbatim
+   // reversePixels( row, cols );
+   @endverbatim
+ *****************************************************************************/
+void reversePixels( pixel* data, int count )
+{
+    active.reversePixels( data, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sharpens one row of a plane, each pixel becomes 5 times itself minus its
+ * four neighbors, cropped to 0 and 255. The first and last pixel of the
+ * row have no left or right neighbor and are left alone.
+ *
+ * @param[in]  above - row above the one being sharpened.
+ * @param[in]  center - row being sharpened.
+ * @param[in]  below - row below the one being sharpened.
+ * @param[out] dest - sharpened row, may not be any of the three source rows.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // sharpenRow( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+void sharpenRow( const pixel* above, const pixel* center, const pixel* below,
+    pixel* dest, int count )
+{
+    active.sharpenRow( above, center, below, dest, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Smooths one row of a plane, each pixel becomes the average of itself and
+ * its eight neighbors. The first and last pixel of the row have no left or
+ * right neighbor and are left alone.
+ *
+ * @param[in]  above - row above the one being smoothed.
+ * @param[in]  center - row being smoothed.
+ * @param[in]  below - row below the one being smoothed.
+ * @param[out] dest - smoothed row, may not be any of the three source rows.
+ * @param[in]  count - number of pixels in a row.
+ *
+ * @par Example
+ * @verbatim
+   // smoothRow( above, center, below, dest, cols );
+   @endverbatim
+ *****************************************************************************/
+void smoothRow( const pixel* above, const pixel* center, const pixel* below,
+    pixel* dest, int count )
+{
+    active.smoothRow( above, center, below, dest, count );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Subtracts an amount from each sample, stopping at 0.
+ *
+ * @param[in,out] data - samples to change.
+ * @param[in]     count - number of samples.
+ * @param[in]     amount - value subtracted from each sample.
+ *
+ * @par Example
+ * @verbatim
+   // subSaturate( row, cols, 40 );
+   @endverbatim
+ *****************************************************************************/
+void subSaturate( pixel* data, int count, pixel amount )
+{
+    active.subSaturate( data, count, amount );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Transposes a plane, the pixel at row i, column j of src goes to row j,
+ * column i of dest. Going down a column of src one pixel at a time would
+ * miss the cache on every write for a large image, so the plane is done in
+ * TRANSPOSE_TILE square tiles that fit in the L1 cache with both their
+ * source and dest rows. Giving a negative stride with a pointer to the last
+ * row flips that side, which turns the transpose into a rotation.
+ *
+ * @param[in]  src - first pixel of the source plane.
+ * @param[in]  srcStride - distance between two source rows, may be negative.
+ * @param[out] dest - first pixel of the dest plane.
+ * @param[in]  destStride - distance between two dest rows, may be negative.
+ * @param[in]  height - number of rows in src.
+ * @param[in]  width - number of columns in src.
+ *
+ * @par Example
+ * @verbatim
+   // transposePlane( src, stride, dest, newStride, rows, cols );
+   @endverbatim
+ *****************************************************************************/
+void transposePlane( const pixel* src, ptrdiff_t srcStride, pixel* dest,
+    ptrdiff_t destStride, int height, int width )
+{
+    int i;
+    int j;
+    int tileHeight;
+    int tileWidth;
+
+    for ( i = 0; i < height; i += TRANSPOSE_TILE )
+    {
+        tileHeight = height - i < TRANSPOSE_TILE ? height - i : TRANSPOSE_TILE;
+        for ( j = 0; j < width; j += TRANSPOSE_TILE )
+        {
+            tileWidth = width - j < TRANSPOSE_TILE ? width - j : TRANSPOSE_TILE;
+            active.transposeTile( src + i * srcStride + j, srcStride,
+                dest + j * destStride + i, destStride, tileHeight, tileWidth );
+        }
+    }
+}
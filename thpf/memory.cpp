@@ -0,0 +1,328 @@
+/** **************************************************************************
+ * @file
+ *
+ * @brief Holds the functions for the pixelArena that hands out and recycles
+ *        the pixel buffers used by netPBM images.
+ ****************************************************************************/
+#include "netPBM.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <cstdlib>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/**
+ * @brief Alignment of every buffer handed out by the arena.
+ */
+const size_t ARENA_ALIGN = 64;
+
+/**
+ * @brief Size of a transparent huge page on linux.
+ */
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+atomic<bool> pixelArena::hugePages( false );
+atomic<size_t> pixelArena::limit( ( size_t ) 1024 * 1024 * 1024 );
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Constructor for the pixelArena class. Starts with an empty pool.
+ *
+ * @par Example
+ * @verbatim
+   // pixelArena arena;
+   @endverbatim
+ *****************************************************************************/
+pixelArena::pixelArena()
+{
+    heldBytes = 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * The deconstructor for the pixelArena class. Frees every buffer still
+ * waiting in the pool.
+ *
+ * @par Example
+ * @verbatim
+   // Don't call the deconstructor, does it automatically.
+   @endverbatim
+ *****************************************************************************/
+pixelArena::~pixelArena()
+{
+    clear();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Hands out a buffer of at least the given size. The smallest buffer in the
+ * pool that fits is reused if it is no more than twice the size asked for,
+ * otherwise a new one is allocated.
+ *
+ * @param[in]     size - number of bytes needed.
+ * @param[out]    capacity - number of bytes in the buffer handed out.
+ *
+ * @returns a pointer to the buffer or nullptr if it could not be allocated.
+ *
+ * @par Example
+ * @verbatim
+   // data = pixelArena::local().acquire( size, capacity );
+   @endverbatim
+ *****************************************************************************/
+pixel* pixelArena::acquire( size_t size, size_t& capacity )
+{
+    size_t i;
+    size_t best;
+    pixel* data;
+
+    // Find the smallest pooled buffer that is big enough.
+    best = pool.size();
+    for ( i = 0; i < pool.size(); i++ )
+    {
+        if ( ( pool[i].capacity >= size ) && ( pool[i].capacity / 2 <= size ) &&
+             ( ( best == pool.size() ) || ( pool[i].capacity < pool[best].capacity ) ) )
+        {
+            best = i;
+        }
+    }
+
+    // Reuse it if one was found.
+    if ( best != pool.size() )
+    {
+        data = pool[best].data;
+        capacity = pool[best].capacity;
+        heldBytes -= capacity;
+        pool[best] = pool.back();
+        pool.pop_back();
+        return data;
+    }
+
+    capacity = size;
+    return allocBuffer( capacity );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Allocates a new aligned buffer. On linux, buffers of a few huge pages or
+ * more are rounded up to whole huge pages and marked to use transparent huge
+ * pages when that has been turned on.
+ *
+ * @param[in,out] capacity - bytes needed, set to the bytes allocated.
+ *
+ * @returns a pointer to the buffer or nullptr if it could not be allocated.
+ *
+ * @par Example
+ * @verbatim
+   // data = allocBuffer( capacity );
+   @endverbatim
+ *****************************************************************************/
+pixel* pixelArena::allocBuffer( size_t& capacity )
+{
+    void* data = nullptr;
+    size_t align = ARENA_ALIGN;
+
+    // Round large buffers up to whole huge pages.
+#ifdef __linux__
+    if ( hugePages && ( capacity >= 4 * HUGE_PAGE_SIZE ) )
+    {
+        align = HUGE_PAGE_SIZE;
+    }
+#endif
+    capacity = ( ( capacity + align - 1 ) / align ) * align;
+    if ( capacity == 0 )
+    {
+        capacity = align;
+    }
+
+#ifdef _WIN32
+    data = _aligned_malloc( capacity, align );
+#else
+    if ( posix_memalign( &data, align, capacity ) != 0 )
+    {
+        data = nullptr;
+    }
+#endif
+
+#ifdef __linux__
+    if ( ( data != nullptr ) && ( align == HUGE_PAGE_SIZE ) )
+    {
+        madvise( data, capacity, MADV_HUGEPAGE );
+    }
+#endif
+
+    return ( pixel* ) data;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Frees every buffer waiting in the pool.
+ *
+ * @par Example
+ * @verbatim
+   // pixelArena::local().clear();
+   @endverbatim
+ *****************************************************************************/
+void pixelArena::clear()
+{
+    size_t i;
+
+    for ( i = 0; i < pool.size(); i++ )
+    {
+        freeBuffer( pool[i].data );
+    }
+
+    pool.clear();
+    heldBytes = 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Frees a buffer made by allocBuffer.
+ *
+ * @param[in]     data - buffer to free.
+ *
+ * @par Example
+ * @verbatim
+   // freeBuffer( data );
+   @endverbatim
+ *****************************************************************************/
+void pixelArena::freeBuffer( pixel* data )
+{
+#ifdef _WIN32
+    _aligned_free( data );
+#else
+    free( data );
+#endif
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the arena that belongs to the calling thread.
+ *
+ * @returns the calling thread's arena.
+ *
+ * @par Example
+ * @verbatim
+   // data = pixelArena::local().acquire( size, capacity );
+   @endverbatim
+ *****************************************************************************/
+pixelArena& pixelArena::local()
+{
+    static thread_local pixelArena arena;
+
+    return arena;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gives a buffer back to the pool so it can be handed out again. If the pool
+ * would hold more than the limit, the buffer is freed instead.
+ *
+ * @param[in]     data - buffer that is no longer used.
+ * @param[in]     capacity - number of bytes in the buffer.
+ *
+ * @par Example
+ * @verbatim
+   // pixelArena::local().release( data, capacity );
+   @endverbatim
+ *****************************************************************************/
+void pixelArena::release( pixel* data, size_t capacity )
+{
+    freeBlock entry;
+
+    if ( data == nullptr )
+    {
+        return;
+    }
+
+    // Free the buffer if keeping it would go over the limit.
+    if ( heldBytes + capacity > limit )
+    {
+        freeBuffer( data );
+        return;
+    }
+
+    entry.data = data;
+    entry.capacity = capacity;
+    pool.push_back( entry );
+    heldBytes += capacity;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets the most bytes that each thread's pool will hold on to. Buffers given
+ * back past this limit are freed.
+ *
+ * @param[in]     bytes - largest number of bytes a pool may hold.
+ *
+ * @par Example
+ * @verbatim
+   // pixelArena::setLimit( 512 * 1024 * 1024 );
+   @endverbatim
+ *****************************************************************************/
+void pixelArena::setLimit( size_t bytes )
+{
+    limit = bytes;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Turns on or off backing large buffers with transparent huge pages. This
+ * only has an effect on linux and only for buffers allocated afterwards.
+ *
+ * @param[in]     enable - true to use huge pages.
+ *
+ * @par Example
+ * @verbatim
+   // pixelArena::useHugePages( true );
+   @endverbatim
+ *****************************************************************************/
+void pixelArena::useHugePages( bool enable )
+{
+    hugePages = enable;
+}
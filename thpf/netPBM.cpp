@@ -4,6 +4,7 @@
  * @brief Holds the functions that are in the netPBM class.
  ****************************************************************************/
 #include "netPBM.h"
+#include <climits>
 
 /** ***************************************************************************
  * @author Aidan Justice
@@ -20,6 +21,12 @@ netPBM::netPBM()
 {
     rows = 0;
     cols = 0;
+    stride = 0;
+    block = nullptr;
+    redGray = nullptr;
+    green = nullptr;
+    blue = nullptr;
+    clearLuts();
 }
 
 
@@ -29,7 +36,8 @@ netPBM::netPBM()
  *
  * @par Description
  * Copy constuctor for the netPBM class. Copies in the private data from an 
- * existing netPBM image to a new one.
+ * existing netPBM image to a new one. The pixels are shared with the existing
+ * image until one of them is changed.
  *
  * @param[in]  img - existing netPBM image to copy
  *
@@ -38,30 +46,49 @@ netPBM::netPBM()
    // netPBM img2( img );
    @endverbatim
  *****************************************************************************/
-netPBM::netPBM( netPBM& img )
+netPBM::netPBM( const netPBM& img )
 {
-    int i;
-    int j;
+    rows = 0;
+    cols = 0;
+    stride = 0;
+    block = nullptr;
+    redGray = nullptr;
+    green = nullptr;
+    blue = nullptr;
+    clearLuts();
+
+    *this = img;
+}
 
-    rows = img.rows;
-    cols = img.cols;
-    comments = img.comments;
 
-    // Allocate new arrays
-    redGray = alloc2d( rows, cols );
-    green = alloc2d( rows, cols );
-    blue = alloc2d( rows, cols );
 
-    // Fill arrays
-    for ( i = 0; i < rows; i++ )
-    {
-        for ( j = 0; j < cols; j++ )
-        {
-            redGray[i][j] = img.redGray[i][j];
-            green[i][j] = img.green[i][j];
-            blue[i][j] = img.blue[i][j];
-        }
-    }
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Move constuctor for the netPBM class. Takes over the pixel block of an
+ * image that is no longer needed instead of copying it, leaving that image
+ * empty.
+ *
+ * @param[in,out]  img - netPBM image to take the data from
+ *
+ * @par Example
+ * @verbatim
+   // netPBM img2( move( img ) );
+   @endverbatim
+ *****************************************************************************/
+netPBM::netPBM( netPBM&& img )
+{
+    rows = 0;
+    cols = 0;
+    stride = 0;
+    block = nullptr;
+    redGray = nullptr;
+    green = nullptr;
+    blue = nullptr;
+    clearLuts();
+
+    *this = move( img );
 }
 
 
@@ -80,9 +107,7 @@ netPBM::netPBM( netPBM& img )
  *****************************************************************************/
 netPBM::~netPBM()
 {
-    free2d( redGray, rows );
-    free2d( green, rows );
-    free2d( blue, rows );
+    freeImage();
 }
 
 
@@ -91,42 +116,61 @@ netPBM::~netPBM()
  * @author Aidan Justice
  *
  * @par Description
- * Dynamically allocates a 2d array of the given size.
- *
- * @param[in]     rows - number of rows in the array.
- * @param[in]     cols - number of columns in the array.
+ * Allocates a single block that holds all three color planes of an image of
+ * the given size. The planes are stored one after another and each row of a
+ * plane starts stride pixels after the previous one, so a whole image can be
+ * copied or freed as one piece. The stride is the width padded up to a
+ * multiple of ROW_ALIGN, so every row of every plane starts on a ROW_ALIGN
+ * boundary. The padding is never read from or written to a file. Any
+ * existing planes are released first and the new block is owned only by
+ * this image. The memory comes from the thread's pixelArena so buffers are
+ * reused across operations.
+ *
+ * @param[in]     height - number of rows in the image.
+ * @param[in]     width - number of columns in the image.
  *
- * @returns a pointer to the array.
+ * @returns true if successful and false otherwise.
  *
  * @par Example
  * @verbatim
-   // redGray = alloc2d( rows, cols );
+   // if ( !allocImage( rows, cols ) )
    @endverbatim
  *****************************************************************************/
-pixel** netPBM::alloc2d(int rows, int cols)
+bool netPBM::allocImage( int height, int width )
 {
-    int i;
-    pixel** arr = nullptr;
+    size_t planeSize;
+    int padded;
 
-    // Create array and check for success.
-    arr = new (nothrow) pixel* [rows];
-    if (arr == nullptr)
+    freeImage();
+
+    // Pad the rows out to the alignment.
+    padded = ( ( width + ROW_ALIGN - 1 ) / ROW_ALIGN ) * ROW_ALIGN;
+
+    // Create the block and check for success.
+    planeSize = ( size_t ) height * padded;
+    block = new ( nothrow ) pixelBlock;
+    if ( block == nullptr )
     {
-        return nullptr;
+        return false;
     }
-
-    // Create each column for the array and check for success.
-    for ( i = 0; i < rows; i++ )
+    block->data = pixelArena::local().acquire( 3 * planeSize, block->size );
+    if ( block->data == nullptr )
     {
-        arr[i] = new ( nothrow ) pixel[cols];
-        if (arr[i] == nullptr)
-        {
-            free2d( arr, i );
-            return nullptr;
-        }
+        delete block;
+        block = nullptr;
+        return false;
     }
+    block->refCount = 1;
 
-    return arr;
+    // Set the dimensions and point each plane into the block.
+    rows = height;
+    cols = width;
+    stride = padded;
+    redGray = block->data;
+    green = block->data + planeSize;
+    blue = block->data + 2 * planeSize;
+
+    return true;
 }
 
 
@@ -135,52 +179,36 @@ pixel** netPBM::alloc2d(int rows, int cols)
  * @author Aidan Justice
  *
  * @par Description
- * Takes each pixel value, the 3 pixels to the left, and the 3 pixels to the 
- * right and finds the average of the 7 pixels to simulate a  horizonta 
- * blurred effect.
+ * Applies the lookup tables waiting to be applied to the pixels. Pointwise
+ * operations like brighten, negate, and contrast don't change the pixels,
+ * they run each plane's table through their change instead. A chain of them
+ * is then done in a single pass here, the first time something needs the
+ * real pixels. Flips and rotations only move pixels around, so they leave
+ * the tables waiting.
  *
  * @par Example
  * @verbatim
-   // img.blur();
+   // applyLuts();
    @endverbatim
  *****************************************************************************/
-void netPBM::blur()
+void netPBM::applyLuts()
 {
-    int i;
-    int j;
-    netPBM temp;
+    int p;
 
-    temp = *this;
+    if ( !lutPending )
+    {
+        return;
+    }
 
-    for ( i = 0; i < rows; i++ )
+    // Get a private copy of the pixels before changing them.
+    makeUnique();
+    pixel* planes[3] = { redGray, green, blue };
+
+    for ( p = 0; p < 3; p++ )
     {
-        for ( j = 0; j < cols; j++ )
-        {
-            // Set border pixels to 0;
-            if ( ( j < 3 ) || ( j > cols - 4 ) )
-            {
-                redGray[i][j] = 0;
-                green[i][j] = 0;
-                blue[i][j] = 0;
-            }
-            // Compute average of adjacent pixels.
-            else
-            {
-                redGray[i][j] = ( temp.redGray[i][j - 3] + temp.redGray[i][j - 2]
-                    + temp.redGray[i][j - 1] + temp.redGray[i][j] 
-                    + temp.redGray[i][j + 1] + temp.redGray[i][j + 2] 
-                    + temp.redGray[i][j + 3] ) / 7;
-                green[i][j] = ( temp.green[i][j - 3] + temp.green[i][j - 2]
-                    + temp.green[i][j - 1] + temp.green[i][j]
-                    + temp.green[i][j + 1] + temp.green[i][j + 2]
-                    + temp.green[i][j + 3] ) / 7;
-                blue[i][j] = ( temp.blue[i][j - 3] + temp.blue[i][j - 2]
-                    + temp.blue[i][j - 1] + temp.blue[i][j]
-                    + temp.blue[i][j + 1] + temp.blue[i][j + 2]
-                    + temp.blue[i][j + 3] ) / 7;
-            }
-        }
+        applyTable( planes[p], luts[p] );
     }
+    clearLuts();
 }
 
 
@@ -189,37 +217,183 @@ void netPBM::blur()
  * @author Aidan Justice
  *
  * @par Description
- * Using the user's given value, it runs through each pixel adding the value
- * to them. Also checks to see if the new value exceeds 255 or is below 0.
- *
- * @param[in]  value - integer to be added to each pixel.
+ * Runs a 3x3 stencil over each plane of the image in place, split into
+ * tiles that are worked on at the same time, see parallelTiles. First each
+ * tile saves its own top and bottom rows and left and right columns, the
+ * pixels its neighbors reach into, so a neighbor that runs after the tile
+ * has been changed still sees the old pixels. Then each tile keeps three
+ * rows of the old pixels in a rolling buffer, copying each row in before
+ * it is overwritten and taking the halo around the tile from what was
+ * saved, instead of a copy of the whole image. The border rows and the
+ * first and last pixel of each row are set to 0 here, so the row kernel
+ * only has to handle the inside of the image.
+ *
+ * @param[in]  rowKernel - computes the inside pixels of one row from the
+ *                         rows above, at, and below it.
  *
  * @par Example
  * @verbatim
-   // img.brighten( 25 );
+   // applyStencil( sharpenRow );
    @endverbatim
  *****************************************************************************/
-void netPBM::brighten( int value )
+void netPBM::applyStencil( void ( *rowKernel )( const pixel*, const pixel*,
+    const pixel*, pixel*, int ) )
 {
     int i;
-    int j;
-    int temp_value;
-
-    // Calculate brightened value for each pixel.
-    for ( i = 0; i < rows; i++ )
+    int p;
+    int down;
+    int across;
+    vector<pixel> edgeRows;
+    vector<pixel> edgeCols;
+
+    // Apply any pointwise changes still waiting in the lookup tables and
+    // get a private copy of the pixels before changing them.
+    applyLuts();
+    makeUnique();
+    pixel* planes[3] = { redGray, green, blue };
+
+    // Too small to have an inside, every pixel is on the border.
+    if ( ( rows < 3 ) || ( cols < 3 ) )
     {
-        for ( j = 0; j < cols; j++ )
+        for ( i = 0; i < rows; i++ )
         {
-            temp_value = ( unsigned long ) redGray[i][j] + value;
-            redGray[i][j] = cropRound( temp_value );
-
-            temp_value = ( unsigned long ) green[i][j] + value;
-            green[i][j] = cropRound( temp_value );
-
-            temp_value = ( unsigned long ) blue[i][j] + value;
-            blue[i][j] = cropRound( temp_value );
+            for ( p = 0; p < 3; p++ )
+            {
+                fillPixels( planes[p] + ( size_t ) i * stride, cols, 0 );
+            }
         }
+        return;
     }
+
+    // Top and bottom row of each band of tiles, full width, and left and
+    // right column of each column of tiles, full height, for each plane.
+    down = ( rows + TILE_ROWS - 1 ) / TILE_ROWS;
+    across = ( cols + TILE_COLS - 1 ) / TILE_COLS;
+    edgeRows.resize( 6 * ( size_t ) down * cols );
+    edgeCols.resize( 6 * ( size_t ) across * rows );
+    auto savedRow = [&]( int p, int band, int side )
+        {
+            return edgeRows.data() + ( ( size_t ) ( p * down + band ) * 2 +
+                side ) * cols;
+        };
+    auto savedCol = [&]( int p, int column, int side )
+        {
+            return edgeCols.data() + ( ( size_t ) ( p * across + column ) *
+                2 + side ) * rows;
+        };
+
+    // Save the old pixels on the edges of each tile.
+    parallelTiles( rows, cols, TILE_ROWS, TILE_COLS,
+        [&]( int top, int left, int bottom, int right )
+        {
+            int i;
+            int p;
+            const pixel* plane;
+
+            for ( p = 0; p < 3; p++ )
+            {
+                plane = planes[p];
+                memcpy( savedRow( p, top / TILE_ROWS, 0 ) + left, plane +
+                    ( size_t ) top * stride + left, right - left );
+                memcpy( savedRow( p, top / TILE_ROWS, 1 ) + left, plane +
+                    ( size_t ) ( bottom - 1 ) * stride + left, right - left );
+                for ( i = top; i < bottom; i++ )
+                {
+                    savedCol( p, left / TILE_COLS, 0 )[i] =
+                        plane[( size_t ) i * stride + left];
+                    savedCol( p, left / TILE_COLS, 1 )[i] =
+                        plane[( size_t ) i * stride + right - 1];
+                }
+            }
+        } );
+
+    // Work out each tile in place from a rolling buffer of three rows.
+    parallelTiles( rows, cols, TILE_ROWS, TILE_COLS,
+        [&]( int top, int left, int bottom, int right )
+        {
+            int i;
+            int p;
+            int start;
+            int end;
+            int first;
+            int last;
+            int width;
+            int band = top / TILE_ROWS;
+            int column = left / TILE_COLS;
+            pixel* plane;
+            pixel* line[3];
+            vector<pixel> lines;
+
+            // Columns of the tile that are inside the border, and the rows.
+            start = max( left, 1 );
+            end = min( right, cols - 1 );
+            first = max( top, 1 );
+            last = min( bottom, rows - 1 );
+            width = end - start + 2;
+            lines.resize( 3 * ( size_t ) max( width, 0 ) );
+            line[0] = lines.data();
+            line[1] = line[0] + max( width, 0 );
+            line[2] = line[1] + max( width, 0 );
+
+            // Copies the old pixels of row r from start - 1 up to end into
+            // dest, from the saved edges where the tile doesn't own them.
+            auto loadRow = [&]( int p, int r, pixel* dest )
+                {
+                    if ( ( r < top ) || ( r >= bottom ) )
+                    {
+                        memcpy( dest, savedRow( p, r < top ? band - 1 :
+                            band + 1, r < top ? 1 : 0 ) + start - 1, width );
+                        return;
+                    }
+                    memcpy( dest + 1, planes[p] + ( size_t ) r * stride +
+                        start, end - start );
+                    dest[0] = start > left ? planes[p][( size_t ) r *
+                        stride + start - 1] : savedCol( p, column - 1, 1 )[r];
+                    dest[width - 1] = end < right ? planes[p][( size_t ) r *
+                        stride + end] : savedCol( p, column + 1, 0 )[r];
+                };
+
+            for ( p = 0; p < 3; p++ )
+            {
+                plane = planes[p];
+                if ( start < end )
+                {
+                    for ( i = first; i < last; i++ )
+                    {
+                        // Bring in the rows around this one before anything
+                        // overwrites them.
+                        if ( i == first )
+                        {
+                            loadRow( p, i - 1, line[( i - 1 ) % 3] );
+                            loadRow( p, i, line[i % 3] );
+                        }
+                        loadRow( p, i + 1, line[( i + 1 ) % 3] );
+                        rowKernel( line[( i - 1 ) % 3], line[i % 3],
+                            line[( i + 1 ) % 3], plane + ( size_t ) i * stride +
+                            start - 1, width );
+                    }
+                }
+
+                // Set the border pixels of the tile to 0.
+                for ( i = top; i < bottom; i++ )
+                {
+                    if ( ( i == 0 ) || ( i == rows - 1 ) || ( start >= end ) )
+                    {
+                        fillPixels( plane + ( size_t ) i * stride + left,
+                            right - left, 0 );
+                        continue;
+                    }
+                    if ( left == 0 )
+                    {
+                        plane[( size_t ) i * stride] = 0;
+                    }
+                    if ( right == cols )
+                    {
+                        plane[( size_t ) i * stride + cols - 1] = 0;
+                    }
+                }
+            }
+        } );
 }
 
 
@@ -228,64 +402,185 @@ void netPBM::brighten( int value )
  * @author Aidan Justice
  *
  * @par Description
- * Find the contrast of the input image. It subtracts the min value from the 
- * gray pixel and the multiplies it by the scale.
+ * Runs every pixel of a plane through a lookup table. Tables that do
+ * nothing are skipped, and tables that fill, invert, or add or subtract
+ * with saturation are done with those kernels, which are quicker than a
+ * lookup. Anything else goes through applyLut. The rows are split into
+ * bands that are changed at the same time, see parallelRows.
+ *
+ * @param[in,out] plane - plane to change.
+ * @param[in]     lut - 256 entry table, each pixel becomes lut[pixel].
  *
  * @par Example
  * @verbatim
-   // img.contrast();
+   // applyTable( redGray, luts[RED_GRAY] );
    @endverbatim
  *****************************************************************************/
-void netPBM::contrast()
+void netPBM::applyTable( pixel* plane, const pixel* lut )
 {
-    int i;
-    int j;
-    double min;
-    double scale;
-
-    // Find the scale and the minimum values.
-    findScale( scale, min );
-
-    for ( i = 0; i < rows; i++ )
+    int v;
+    int shift;
+    bool same = true;
+    bool flat = true;
+    bool invert = true;
+    bool added = true;
+    bool taken = true;
+
+    // Work out what kind of table it is.
+    shift = lut[128] - 128;
+    for ( v = 0; v < 256; v++ )
     {
-        for ( j = 0; j < cols; j++ )
-        {
-            redGray[i][j] = ( pixel ) ( scale * ( redGray[i][j] - min ) );
-        }
+        same = same && ( lut[v] == v );
+        flat = flat && ( lut[v] == lut[0] );
+        invert = invert && ( lut[v] == 255 - v );
+        added = added && ( shift >= 0 ) &&
+            ( lut[v] == ( v + shift > 255 ? 255 : v + shift ) );
+        taken = taken && ( shift <= 0 ) &&
+            ( lut[v] == ( v + shift < 0 ? 0 : v + shift ) );
+    }
+    if ( same )
+    {
+        return;
     }
+
+    // Change the rows a band at a time on the threads of the pool.
+    parallelRows( rows, BAND_ROWS, [&]( int first, int last )
+        {
+            int i;
+            pixel* row;
+
+            for ( i = first; i < last; i++ )
+            {
+                row = plane + ( size_t ) i * stride;
+                if ( flat )
+                {
+                    fillPixels( row, cols, lut[0] );
+                }
+                else if ( invert )
+                {
+                    invertPixels( row, cols );
+                }
+                else if ( added )
+                {
+                    addSaturate( row, cols, ( pixel ) shift );
+                }
+                else if ( taken )
+                {
+                    subSaturate( row, cols, ( pixel ) -shift );
+                }
+                else
+                {
+                    applyLut( row, cols, lut );
+                }
+            }
+        } );
 }
 
 
 
 /** ***************************************************************************
  * @author Aidan Justice
- * 
- * @par Description 
- * Ensures the given value is not larger than 255 or smaller than 0. If the
- * value is larger than 255, it crops it to 255 and if it is smaller than 0,
- * it crops it to 0.
- * 
- * @param[in]  value - double to check.
- * 
- * @returns value typecasted to a pixel.
- * 
+ *
+ * @par Description
+ * Takes each pixel value, the radius pixels to the left, and the radius
+ * pixels to the right and finds the average of them to simulate a horizontal
+ * blurred effect. A running sum is kept across each row, adding the pixel
+ * that enters the window and taking away the one that leaves it, so each
+ * pixel costs the same no matter how large the radius is. Pixels closer than
+ * radius to the left or right edge are set to 0. The image is split into
+ * tiles that are blurred at the same time, see parallelTiles.
+ *
+ * @param[in]  radius - number of pixels on each side to average in.
+ *
  * @par Example
  * @verbatim
-   // new_value = cropRound( value );
+   // img.blur( 3 );
    @endverbatim
  *****************************************************************************/
-pixel netPBM::cropRound( double value )
+void netPBM::blur( int radius )
 {
-    if ( value > 255 )
+    int tileCols;
+    netPBM temp;
+
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
+
+    // A negative radius averages nothing in, and past the size of the image
+    // the window never fits, so keep 2 * radius + 1 from overflowing.
+    if ( radius < 0 )
     {
-        value = 255;
+        radius = 0;
     }
-    else if ( value < 0 )
+    if ( radius > max( rows, cols ) )
     {
-        value = 0;
+        radius = max( rows, cols );
     }
 
-    return ( pixel ) value;
+    // Share the pixels with temp to read from and get fresh planes to write,
+    // leaving the image as it was if there is no room for them.
+    temp = *this;
+    if ( !allocImage( temp.rows, temp.cols ) )
+    {
+        *this = move( temp );
+        return;
+    }
+    const pixel* from[3] = { temp.redGray, temp.green, temp.blue };
+    pixel* to[3] = { redGray, green, blue };
+
+    // Blur a tile at a time on the threads of the pool, keeping the tiles
+    // wide enough that the halo read on each side is not much extra.
+    tileCols = max( TILE_COLS, 8 * min( radius, cols / 8 + 1 ) );
+    parallelTiles( rows, cols, TILE_ROWS, tileCols,
+        [&]( int top, int left, int bottom, int right )
+        {
+            int i;
+            int j;
+            int p;
+            int start;
+            int end;
+            int width;
+            unsigned int sum;
+            const pixel* src;
+            pixel* dest;
+
+            // Columns of the tile the window fits around.
+            start = max( left, radius );
+            end = min( right, cols - radius );
+            width = 2 * radius + 1;
+            for ( i = top; i < bottom; i++ )
+            {
+                for ( p = 0; p < 3; p++ )
+                {
+                    src = from[p] + ( size_t ) i * temp.stride;
+                    dest = to[p] + ( size_t ) i * stride;
+
+                    // The window does not fit, every pixel is a border pixel.
+                    if ( start >= end )
+                    {
+                        fillPixels( dest + left, right - left, 0 );
+                        continue;
+                    }
+
+                    // Set border pixels to 0.
+                    fillPixels( dest + left, start - left, 0 );
+                    fillPixels( dest + end, right - end, 0 );
+
+                    // Slide the window across the tile, starting with the
+                    // halo pixels to the left of it.
+                    sum = 0;
+                    for ( j = start - radius; j < start + radius; j++ )
+                    {
+                        sum += src[j];
+                    }
+                    for ( j = start; j < end; j++ )
+                    {
+                        sum += src[j + radius];
+                        dest[j] = ( pixel ) ( sum / width );
+                        sum -= src[j - radius];
+                    }
+                }
+            }
+        } );
 }
 
 
@@ -294,45 +589,119 @@ pixel netPBM::cropRound( double value )
  * @author Aidan Justice
  *
  * @par Description
- * Finds the minimum and the scale used in the contrast function. Scale is 
- * found by taking the maximum value minus the minimum value and then divinding
- * that from 255.
+ * Vertical version of blur. Each pixel becomes the average of itself and the
+ * radius pixels above and below it. A running sum is kept for every column
+ * and the rows are gone over top to bottom, adding the row that enters the
+ * window and taking away the one that leaves it. Pixels closer than radius
+ * to the top or bottom edge are set to 0. The image is split into tiles
+ * that are blurred at the same time, see parallelTiles, each starting its
+ * sums over from the radius halo rows above it.
  *
- * @param[in,out] scale - 255 / ( max - min )
- * @param[in,out] min - minimum grayscale value in the img.
+ * @param[in]  radius - number of pixels above and below to average in.
  *
  * @par Example
  * @verbatim
-   // findScale( scale, min );
+   // img.blurVertical( 3 );
    @endverbatim
  *****************************************************************************/
-void netPBM::findScale( double& scale, double& min )
+void netPBM::blurVertical( int radius )
 {
-    int i;
-    int j;
-    double max;
+    int width;
+    int tileRows;
+    netPBM temp;
 
-    min = redGray[0][0];
-    max = redGray[0][0];
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
 
-    // Find min and max values.
-    for ( i = 0; i < rows; i++ )
+    // A negative radius averages nothing in, and past the size of the image
+    // the window never fits, so keep 2 * radius + 1 from overflowing.
+    if ( radius < 0 )
+    {
+        radius = 0;
+    }
+    if ( radius > max( rows, cols ) )
+    {
+        radius = max( rows, cols );
+    }
+
+    // Share the pixels with temp to read from and get fresh planes to write,
+    // leaving the image as it was if there is no room for them.
+    temp = *this;
+    if ( !allocImage( temp.rows, temp.cols ) )
     {
-        for ( j = 0; j < cols; j++ )
+        *this = move( temp );
+        return;
+    }
+    const pixel* from[3] = { temp.redGray, temp.green, temp.blue };
+    pixel* to[3] = { redGray, green, blue };
+
+    // Blur a tile at a time on the threads of the pool, keeping the tiles
+    // tall enough that the halo read above each is not much extra.
+    width = 2 * radius + 1;
+    tileRows = max( TILE_ROWS, 8 * min( radius, rows / 8 + 1 ) );
+    parallelTiles( rows, cols, tileRows, TILE_COLS,
+        [&]( int top, int left, int bottom, int right )
         {
-            if ( redGray[i][j] < min )
+            int i;
+            int j;
+            int p;
+            int start;
+            int end;
+            const pixel* src;
+            pixel* dest;
+            vector<unsigned int> sums;
+
+            // Rows of the tile the window fits around.
+            start = max( top, radius );
+            end = min( bottom, rows - radius );
+            for ( p = 0; p < 3; p++ )
             {
-                min = redGray[i][j];
+                // Set border rows to 0, every row if the window does not fit.
+                for ( i = top; i < bottom; i++ )
+                {
+                    if ( ( i < start ) || ( i >= end ) )
+                    {
+                        fillPixels( to[p] + ( size_t ) i * stride + left,
+                            right - left, 0 );
+                    }
+                }
+                if ( start >= end )
+                {
+                    continue;
+                }
+
+                // Sum up the halo rows above the tile and the rows of the
+                // window below its first row.
+                sums.assign( right - left, 0 );
+                for ( i = start - radius; i < start + radius; i++ )
+                {
+                    src = from[p] + ( size_t ) i * temp.stride + left;
+                    for ( j = 0; j < right - left; j++ )
+                    {
+                        sums[j] += src[j];
+                    }
+                }
+
+                // Slide the window down the tile.
+                for ( i = start; i < end; i++ )
+                {
+                    src = from[p] + ( size_t ) ( i + radius ) * temp.stride +
+                        left;
+                    dest = to[p] + ( size_t ) i * stride + left;
+                    for ( j = 0; j < right - left; j++ )
+                    {
+                        sums[j] += src[j];
+                        dest[j] = ( pixel ) ( sums[j] / width );
+                    }
+                    src = from[p] + ( size_t ) ( i - radius ) * temp.stride +
+                        left;
+                    for ( j = 0; j < right - left; j++ )
+                    {
+                        sums[j] -= src[j];
+                    }
+                }
             }
-            if ( redGray[i][j] > max )
-            {
-                max = redGray[i][j];
-            }
-        }
-    }
-
-    // Calculate scale.
-    scale = 255.0 / ( max - min );
+        } );
 }
 
 
@@ -341,33 +710,34 @@ void netPBM::findScale( double& scale, double& min )
  * @author Aidan Justice
  *
  * @par Description
- * Flips the images along the x-axis. It goes from column to column, swapping
- * the two opposite rows.
+ * Takes each pixel in image and adds a given value to it while making sure 
+ * that pixel is not less than 0 or greater than 255. The pixels are not
+ * touched yet, the change is added to the lookup tables waiting to be
+ * applied, see applyLuts.
+ *
+ * @param[in]  value - the amount to add to each pixel.
  *
  * @par Example
  * @verbatim
-   // img.flipx();
+   // img.brighten( 25 );
    @endverbatim
  *****************************************************************************/
-void netPBM::flipx()
+void netPBM::brighten( int value )
 {
-    int i;
-    int j;
-    int mid;
-    
-    // Find midpoint of the rows.
-    mid = rows / 2;
+    int p;
+    int v;
+    int result;
 
-    // Run through array, swapping opposite rows, making sure to only go half way.
-    for ( j = 0; j < cols; j++ )
+    for ( p = 0; p < 3; p++ )
     {
-        for ( i = 0; i < mid; i++ )
+        for ( v = 0; v < 256; v++ )
         {
-            swap( redGray[i][j], redGray[rows - 1 - i][j] );
-            swap( green[i][j], green[rows - 1 - i][j] );
-            swap( blue[i][j], blue[rows - 1 - i][j] );
+            result = luts[p][v] + value;
+            luts[p][v] = ( pixel ) ( result < 0 ? 0 : result > 255 ? 255 :
+                result );
         }
     }
+    lutPending = true;
 }
 
 
@@ -376,33 +746,27 @@ void netPBM::flipx()
  * @author Aidan Justice
  *
  * @par Description
- * Flips the image along the y-axis. It goes from row to row, swapping the 
- * opposite columns.
- * 
+ * Sets every lookup table back to leaving the pixels as they are, throwing
+ * away any pointwise changes waiting to be applied.
+ *
  * @par Example
  * @verbatim
-   // img.flipy();
+   // clearLuts();
    @endverbatim
  *****************************************************************************/
-void netPBM::flipy()
+void netPBM::clearLuts()
 {
-    int i;
-    int j;
-    int mid;
+    int p;
+    int v;
 
-    // Find midpoint of the columns.
-    mid = cols / 2;
-
-    // Run through array, swapping the opposite columns.
-    for ( i = 0; i < rows; i++ )
+    for ( p = 0; p < 3; p++ )
     {
-        for ( j = 0; j < mid; j++ )
+        for ( v = 0; v < 256; v++ )
         {
-            swap( redGray[i][j], redGray[i][cols - 1 - j] );
-            swap( green[i][j], green[i][cols - 1 - j] );
-            swap( blue[i][j], blue[i][cols - 1 - j] );
+            luts[p][v] = ( pixel ) v;
         }
     }
+    lutPending = false;
 }
 
 
@@ -411,28 +775,50 @@ void netPBM::flipy()
  * @author Aidan Justice
  *
  * @par Description
- * Deletes the given array.
- *
- * @param[in,out] arr - pointer to the array to be deleted.
- * @param[in]     rows - amount of rows in the array.
+ * Find the contrast of the input image. It subtracts the min value from the 
+ * gray pixel and the multiplies it by the scale. The min and max are found
+ * from the stored pixels and, as long as the gray table waiting to be
+ * applied only ever goes up or only ever goes down, run through it, so the
+ * pixels are only read here and written once when the tables are applied.
  *
  * @par Example
  * @verbatim
-   // free2d( redGray, rows );
+   // img.contrast();
    @endverbatim
  *****************************************************************************/
-void netPBM::free2d( pixel** &arr, int rows )
+void netPBM::contrast()
 {
-    int i;
+    int v;
+    bool rising = true;
+    bool falling = true;
+    pixel low = 255;
+    pixel high = 0;
+    const pixel* gray = luts[RED_GRAY];
+
+    // A table that goes up and down can't map the range, apply it first.
+    for ( v = 1; v < 256; v++ )
+    {
+        rising = rising && ( gray[v] >= gray[v - 1] );
+        falling = falling && ( gray[v] <= gray[v - 1] );
+    }
+    if ( !rising && !falling )
+    {
+        applyLuts();
+    }
 
-    // Delete columns
-    for ( i = 0; i < rows; i++ )
+    // Find the min and max values.
+    findGrayRange( low, high );
+    if ( low <= high )
     {
-        delete[] arr[i];
+        low = gray[low];
+        high = gray[high];
+        if ( low > high )
+        {
+            swap( low, high );
+        }
     }
 
-    // Delete the array
-    delete[] arr;
+    stretchGray( low, high );
 }
 
 
@@ -441,29 +827,57 @@ void netPBM::free2d( pixel** &arr, int rows )
  * @author Aidan Justice
  *
  * @par Description
- * Converts the image to grayscale. It multiplies the red pixel by .3, the 
- * green by .6, and blue by .1, then add them all together to get the gray
- * pixel value.
+ * Copies the pixels into a new block owned only by this image, letting go
+ * of the old block. If the planes take up the old block from its start the
+ * whole thing is copied at once, otherwise the image is a view and it is
+ * copied a row at a time.
  *
  * @par Example
  * @verbatim
-   // img.grayscale();
+   // copyPixels();
    @endverbatim
  *****************************************************************************/
-void netPBM::grayscale()
+void netPBM::copyPixels()
 {
     int i;
-    int j;
-
-    // Calculate gray values for each pixel.
-    for ( i = 0; i < rows; i++ )
+    int p;
+    int oldStride;
+    bool view;
+    pixelBlock *shared;
+    pixel *source[3];
+
+    // Hold on to the shared block while the pixels are copied out of it.
+    shared = block;
+    shared->refCount++;
+    source[0] = redGray;
+    source[1] = green;
+    source[2] = blue;
+    oldStride = stride;
+    view = isView();
+
+    if ( allocImage( rows, cols ) )
     {
-        for ( j = 0; j < cols; j++ )
+        pixel* planes[3] = { redGray, green, blue };
+        if ( !view )
+        {
+            memcpy( block->data, source[0], imageSize() );
+        }
+        for ( p = 0; view && ( p < 3 ); p++ )
         {
-            redGray[i][j] = ( pixel ) ( ( .3 * redGray[i][j] ) + ( .6 * green[i][j] )
-                + ( .1 * blue[i][j] ) );
+            for ( i = 0; i < rows; i++ )
+            {
+                memcpy( planes[p] + ( size_t ) i * stride,
+                    source[p] + ( size_t ) i * oldStride, cols );
+            }
         }
     }
+
+    // Let go of the shared block, releasing it if everyone else already has.
+    if ( --shared->refCount == 0 )
+    {
+        pixelArena::local().release( shared->data, shared->size );
+        delete shared;
+    }
 }
 
 
@@ -472,74 +886,25 @@ void netPBM::grayscale()
  * @author Aidan Justice
  *
  * @par Description
- * Using the user's given row, col, height, and width, it makes a smaller
- * image that is a snippit of the original.
- *
- * @param[in]  row - row to start from
- * @param[in]  col - column to start from
- * @param[in]  height - height of the icon
- * @param[in]  width - width of the the icon
+ * Gives the image its own compact copy of its pixels. A view keeps the
+ * whole block of the image it was taken from alive, so a small view of a
+ * large image that is going to be kept around should be detached. Does
+ * nothing if the image already has a block of its own.
  *
  * @par Example
  * @verbatim
-   // img.icon( 50, 50, 300, 350 );
+   // thumb = img.view( 0, 0, 64, 64 );
+   // thumb.detach();
    @endverbatim
  *****************************************************************************/
-void netPBM::icon( int row, int col, int height, int width )
+void netPBM::detach()
 {
-    int i;
-    int j;
-    netPBM temp;
-
-    // Check to see if height and width are too big.
-    if ( height > rows )
-    {
-        height = rows;
-        row = 0;
-    }
-    if ( width > cols )
-    {
-        width = cols;
-        col = 0;
-    }
-
-    // Get a temporary image to store old values.
-    temp = *this;
-    
-    // Free the arrays of the original image.
-    free2d( redGray, rows );
-    free2d( green, rows );
-    free2d( blue, rows );
-
-    // Set new dimensions.
-    rows = height;
-    cols = width;
-
-    // Allocate new arrays.
-    redGray = alloc2d( rows, cols );
-    green = alloc2d( rows, cols );
-    blue = alloc2d( rows, cols );
-
-    // Get an appropriate starting point.
-    if ( ( height + row ) > temp.rows )
-    {
-        row = temp.rows - height;
-    }
-    if ( ( width + col ) > temp.cols )
+    if ( ( block == nullptr ) || ( ( block->refCount == 1 ) && !isView() ) )
     {
-        col = temp.cols - width;
+        return;
     }
 
-    // Run through the new image, setting the pixels equal to the original.
-    for ( i = 0; i < height; i++ )
-    {
-        for ( j = 0; j < width; j++ )
-        {
-            redGray[i][j] = temp.redGray[row + i][col + j];
-            green[i][j] = temp.green[row + i][col + j];
-            blue[i][j] = temp.blue[row + i][col + j];
-        }
-    }
+    copyPixels();
 }
 
 
@@ -548,29 +913,42 @@ void netPBM::icon( int row, int col, int height, int width )
  * @author Aidan Justice
  *
  * @par Description
- * Negates each pixel stored in the image. It takes each pixel and subtracts it
- * from the max color value, 255.
+ * Finds the smallest and largest value in the gray plane. Each band of rows
+ * finds its own min and max on a thread of the pool, see parallelRows, and
+ * they are put together at the end. If the image has no pixels low is left
+ * above high.
+ *
+ * @param[out]    low - smallest gray value.
+ * @param[out]    high - largest gray value.
  *
  * @par Example
  * @verbatim
-   // img.negate();
+   // findGrayRange( low, high );
    @endverbatim
  *****************************************************************************/
-void netPBM::negate()
+void netPBM::findGrayRange( pixel& low, pixel& high ) const
 {
-    int i;
-    int j;
+    mutex merge;
 
-    // Negate each pixel.
-    for ( i = 0; i < rows; i++ )
-    {
-        for ( j = 0; j < cols; j++ )
+    low = 255;
+    high = 0;
+    parallelRows( rows, BAND_ROWS, [&]( int first, int last )
         {
-            redGray[i][j] = 255 - redGray[i][j];
-            green[i][j] = 255 - green[i][j];
-            blue[i][j] = 255 - blue[i][j];
-        }
-    }
+            int i;
+            pixel bandLow = 255;
+            pixel bandHigh = 0;
+
+            for ( i = first; i < last; i++ )
+            {
+                findRange( redGray + ( size_t ) i * stride, cols, bandLow,
+                    bandHigh );
+            }
+
+            // Fold the band's range into the image's.
+            lock_guard<mutex> guard( merge );
+            low = min( low, bandLow );
+            high = max( high, bandHigh );
+        } );
 }
 
 
@@ -579,45 +957,69 @@ void netPBM::negate()
  * @author Aidan Justice
  *
  * @par Description
- * Overload the = operator to easily set to netPBM images equal.
- *
- * @param[in]  img - existing netPBM image.
+ * Flips the images along the x-axis by swapping each row with the opposite
+ * row, a whole row at a time. If the pixels are shared with another image,
+ * the rows are copied into fresh planes in reverse order instead, so they
+ * are only moved once. Either way bands of rows are moved at the same time,
+ * see parallelRows.
  *
  * @par Example
  * @verbatim
-   // img = img2;
+   // img.flipx();
    @endverbatim
  *****************************************************************************/
-void netPBM::operator=( netPBM img )
+void netPBM::flipx()
 {
-    int i;
-    int j;
-
-    // Free existing arrays
-    free2d( redGray, rows );
-    free2d( green, rows );
-    free2d( blue, rows );
-
-    // Get private data.
-    rows = img.rows;
-    cols = img.cols;
-    comments = img.comments;
-
-    // Allocate new arrays
-    redGray = alloc2d( rows, cols );
-    green = alloc2d( rows, cols );
-    blue = alloc2d( rows, cols );
+    netPBM temp;
 
-    // Fill arrays
-    for ( i = 0; i < rows; i++ )
+    // Shared pixels, copy the rows into new planes bottom up.
+    if ( ( block != nullptr ) && ( block->refCount > 1 ) )
     {
-        for ( j = 0; j < cols; j++ )
+        temp = *this;
+        if ( !allocImage( temp.rows, temp.cols ) )
         {
-            redGray[i][j] = img.redGray[i][j];
-            green[i][j] = img.green[i][j];
-            blue[i][j] = img.blue[i][j];
+            *this = move( temp );
+            return;
         }
+        parallelRows( rows, BAND_ROWS, [&]( int first, int last )
+            {
+                int i;
+
+                for ( i = first; i < last; i++ )
+                {
+                    memcpy( redGray + ( size_t ) i * stride, temp.redGray +
+                        ( size_t ) ( rows - 1 - i ) * temp.stride, cols );
+                    memcpy( green + ( size_t ) i * stride, temp.green +
+                        ( size_t ) ( rows - 1 - i ) * temp.stride, cols );
+                    memcpy( blue + ( size_t ) i * stride, temp.blue +
+                        ( size_t ) ( rows - 1 - i ) * temp.stride, cols );
+                }
+            } );
+        return;
     }
+
+    // Swap opposite rows, making sure to only go half way.
+    pixel* planes[3] = { redGray, green, blue };
+    parallelRows( rows / 2, BAND_ROWS, [&]( int first, int last )
+        {
+            int i;
+            int p;
+            pixel* top;
+            pixel* bottom;
+            vector<pixel> line( cols );
+
+            for ( p = 0; p < 3; p++ )
+            {
+                for ( i = first; i < last; i++ )
+                {
+                    top = planes[p] + ( size_t ) i * stride;
+                    bottom = planes[p] + ( size_t ) ( rows - 1 - i ) * stride;
+                    memcpy( line.data(), top, cols );
+                    memcpy( top, bottom, cols );
+                    memcpy( bottom, line.data(), cols );
+                }
+            }
+        } );
 }
 
 
@@ -626,43 +1028,32 @@ void netPBM::operator=( netPBM img )
  * @author Aidan Justice
  *
  * @par Description
- * Overload the == operator to check if two netPBM images are equal.
- *
- * @param[in]  img - netPBM to compare with.
- *
- * @returns true if equal, false otherwise.
- *
+ * Flips the image along the y-axis. It goes from row to row, reversing each
+ * one with reversePixels. Bands of rows are reversed at the same time, see
+ * parallelRows.
+ * 
  * @par Example
  * @verbatim
-   // if ( img == img2 )
+   // img.flipy();
    @endverbatim
  *****************************************************************************/
-bool netPBM::operator==( netPBM img )
+void netPBM::flipy()
 {
-    int i;
-    int j;
-
-    // Check to see if rows and cols are the same.
-    if ( (rows != img.rows) || (cols != img.cols) )
-    {
-        return false;
-    }
+    // Get a private copy of the pixels before changing them.
+    makeUnique();
 
-    // Run through arrays to see if each pixel is the same.
-    for ( i = 0; i < rows; i++ )
-    {
-        for ( j = 0; j < cols; j++ )
+    // Reverse every row of each plane, a band of rows on each thread.
+    parallelRows( rows, BAND_ROWS, [&]( int first, int last )
         {
-            if ( ( redGray[i][j] != img.redGray[i][j] ) ||
-                 ( green[i][j] != img.green[i][j] ) ||
-                 ( blue [i][j] != img.blue[i][j] ) )
+            int i;
+
+            for ( i = first; i < last; i++ )
             {
-                return false;
+                reversePixels( redGray + ( size_t ) i * stride, cols );
+                reversePixels( green + ( size_t ) i * stride, cols );
+                reversePixels( blue + ( size_t ) i * stride, cols );
             }
-        }
-    }
-
-    return true;
+        } );
 }
 
 
@@ -671,19 +1062,594 @@ bool netPBM::operator==( netPBM img )
  * @author Aidan Justice
  *
  * @par Description
- * Overload the != operator to easily check if two netPBM images are not 
- * equal.
- *
- * @param[in]  img - netPBM image to compare.
- *
- * @returns true if successful and false otherwise.
+ * Releases this image's hold on the block holding the color planes and
+ * resets the image to be empty. The block is given back to the arena once no
+ * other image is sharing it.
  *
  * @par Example
  * @verbatim
-   // if ( img != img2 )
+   // freeImage();
    @endverbatim
  *****************************************************************************/
-bool netPBM::operator!=( netPBM img )
+void netPBM::freeImage()
+{
+    // Give the pixels back to the arena if this was the last image using it.
+    if ( ( block != nullptr ) && ( --block->refCount == 0 ) )
+    {
+        pixelArena::local().release( block->data, block->size );
+        delete block;
+    }
+
+    block = nullptr;
+    redGray = nullptr;
+    green = nullptr;
+    blue = nullptr;
+    rows = 0;
+    cols = 0;
+    stride = 0;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the number of columns in the image.
+ *
+ * @returns the width of the image.
+ *
+ * @par Example
+ * @verbatim
+   // width = img.getCols();
+   @endverbatim
+ *****************************************************************************/
+int netPBM::getCols() const
+{
+    return cols;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets a row of one of the color planes that is about to be changed. The
+ * pixels are copied first if they are shared with another image. Rows are
+ * getStride() pixels apart. Only if the image owns its block do the rows
+ * start on a ROW_ALIGN boundary with getStride() pixels safe to touch. The
+ * rows of a view, such as one made by view() or icon, start at whatever
+ * column it was cut from, and only getCols() pixels of them are safe.
+ *
+ * @param[in]  plane - color plane to get the row from.
+ * @param[in]  row - index of the row.
+ *
+ * @returns a pointer to the first pixel in the row.
+ *
+ * @par Example
+ * @verbatim
+   // red = img.getEditableRow( netPBM::RED_GRAY, i );
+   @endverbatim
+ *****************************************************************************/
+pixel* netPBM::getEditableRow( colorPlane plane, int row )
+{
+    applyLuts();
+    makeUnique();
+
+    return ( pixel* ) getRow( plane, row );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets a row of one of the color planes to read from. Any pointwise
+ * changes still waiting in the lookup tables are applied first, which can
+ * copy the pixels if they are shared, so this is not const. Rows are
+ * getStride() pixels apart. Only if the image owns its block do the rows start on a
+ * ROW_ALIGN boundary with getStride() pixels safe to read. The rows of a
+ * view, such as one made by view() or icon, start at whatever column it was
+ * cut from, and only getCols() pixels of them may be read.
+ *
+ * @param[in]  plane - color plane to get the row from.
+ * @param[in]  row - index of the row.
+ *
+ * @returns a pointer to the first pixel in the row.
+ *
+ * @par Example
+ * @verbatim
+   // red = img.getRow( netPBM::RED_GRAY, i );
+   @endverbatim
+ *****************************************************************************/
+const pixel* netPBM::getRow( colorPlane plane, int row )
+{
+    applyLuts();
+
+    if ( plane == GREEN )
+    {
+        return green + ( size_t ) row * stride;
+    }
+    if ( plane == BLUE )
+    {
+        return blue + ( size_t ) row * stride;
+    }
+
+    return redGray + ( size_t ) row * stride;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the number of rows in the image.
+ *
+ * @returns the height of the image.
+ *
+ * @par Example
+ * @verbatim
+   // height = img.getRows();
+   @endverbatim
+ *****************************************************************************/
+int netPBM::getRows() const
+{
+    return rows;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the distance in pixels between the start of two rows of a plane. It
+ * is always a multiple of ROW_ALIGN and at least the width of the image.
+ *
+ * @returns the row stride.
+ *
+ * @par Example
+ * @verbatim
+   // stride = img.getStride();
+   @endverbatim
+ *****************************************************************************/
+int netPBM::getStride() const
+{
+    return stride;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Converts the image to grayscale. It multiplies the red pixel by .3, the 
+ * green by .6, and blue by .1, then add them all together to get the gray
+ * pixel value. The fixed point mode computes ( 3r + 6g + b ) / 10 rounded
+ * down, the exact mode uses the same double precision math as older
+ * versions and sometimes gives one less, see grayscaleExact. Bands of rows
+ * are done at the same time, see parallelRows.
+ *
+ * @param[in]  mode - GRAY_FIXED or GRAY_EXACT.
+ *
+ * @par Example
+ * @verbatim
+   // img.grayscale( netPBM::GRAY_FIXED );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::grayscale( grayMode mode )
+{
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
+
+    // Get a private copy of the pixels before changing them.
+    makeUnique();
+
+    // Calculate gray values for a band of rows on each thread of the pool.
+    parallelRows( rows, BAND_ROWS, [&]( int first, int last )
+        {
+            int i;
+            pixel* row;
+
+            for ( i = first; i < last; i++ )
+            {
+                row = redGray + ( size_t ) i * stride;
+                if ( mode == GRAY_EXACT )
+                {
+                    grayscaleExact( row, green + ( size_t ) i * stride,
+                        blue + ( size_t ) i * stride, row, cols );
+                }
+                else
+                {
+                    grayscaleFixed( row, green + ( size_t ) i * stride,
+                        blue + ( size_t ) i * stride, row, cols );
+                }
+            }
+        } );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Converts the image to grayscale and stretches its contrast in one pass.
+ * Each row is turned to gray and its min and max found while it is still in
+ * the cache, then the stretch is done through a 256 entry table, so the color
+ * planes are read once and the gray plane is gone over once more. Bands of
+ * rows are done at the same time, each finding its own min and max, which
+ * are put together at the end. Gives the same pixels as grayscale followed
+ * by contrast.
+ *
+ * @param[in]  mode - GRAY_FIXED or GRAY_EXACT.
+ *
+ * @par Example
+ * @verbatim
+   // img.grayscaleContrast( netPBM::GRAY_FIXED );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::grayscaleContrast( grayMode mode )
+{
+    pixel low = 255;
+    pixel high = 0;
+    mutex merge;
+
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
+
+    // Get a private copy of the pixels before changing them.
+    makeUnique();
+
+    // Calculate gray values and the min and max of each band of rows.
+    parallelRows( rows, BAND_ROWS, [&]( int first, int last )
+        {
+            int i;
+            pixel* row;
+            pixel bandLow = 255;
+            pixel bandHigh = 0;
+
+            for ( i = first; i < last; i++ )
+            {
+                row = redGray + ( size_t ) i * stride;
+                if ( mode == GRAY_EXACT )
+                {
+                    grayscaleExact( row, green + ( size_t ) i * stride,
+                        blue + ( size_t ) i * stride, row, cols );
+                }
+                else
+                {
+                    grayscaleFixed( row, green + ( size_t ) i * stride,
+                        blue + ( size_t ) i * stride, row, cols );
+                }
+                findRange( row, cols, bandLow, bandHigh );
+            }
+
+            // Fold the band's range into the image's.
+            lock_guard<mutex> guard( merge );
+            low = min( low, bandLow );
+            high = max( high, bandHigh );
+        } );
+
+    stretchGray( low, high );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Crops the image down to an icon. The image becomes a view of its old
+ * pixels, so no pixels are copied. See view for how the window is fitted
+ * inside the image.
+ *
+ * @param[in]  row - starting row of the icon.
+ * @param[in]  col - starting column of the icon.
+ * @param[in]  height - height of the icon.
+ * @param[in]  width - width of the icon.
+ *
+ * @par Example
+ * @verbatim
+   // img.icon( row, col, height, width );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::icon( int row, int col, int height, int width )
+{
+    *this = view( row, col, height, width );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Finds the number of bytes in the block that holds the three color planes.
+ *
+ * @returns the size of the pixel block in bytes.
+ *
+ * @par Example
+ * @verbatim
+   // memcpy( block->data, source[0], imageSize() );
+   @endverbatim
+ *****************************************************************************/
+size_t netPBM::imageSize() const
+{
+    return 3 * ( size_t ) rows * stride;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Checks if the image is a view, meaning its planes do not take up its
+ * block from the start the way allocImage lays them out.
+ *
+ * @returns true if the image is a view into a larger block.
+ *
+ * @par Example
+ * @verbatim
+   // if ( isView() )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::isView() const
+{
+    size_t planeSize = ( size_t ) rows * stride;
+
+    return ( block != nullptr ) && ( ( redGray != block->data ) ||
+        ( green != redGray + planeSize ) || ( blue != green + planeSize ) );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Makes sure this image is the only one using its block of pixels. If the
+ * block is shared with other images, the pixels are copied into a new block
+ * so they can be changed without affecting the other images. A view that is
+ * the only one left using its block is changed in place.
+ *
+ * @par Example
+ * @verbatim
+   // makeUnique();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::makeUnique()
+{
+    if ( ( block == nullptr ) || ( block->refCount == 1 ) )
+    {
+        return;
+    }
+
+    copyPixels();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Negates each pixel stored in the image. It takes each pixel and subtracts
+ * it from the max color value, 255. The change is added to the lookup
+ * tables waiting to be applied, see applyLuts.
+ *
+ * @par Example
+ * @verbatim
+   // img.negate();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::negate()
+{
+    int p;
+    int v;
+
+    for ( p = 0; p < 3; p++ )
+    {
+        for ( v = 0; v < 256; v++ )
+        {
+            luts[p][v] = 255 - luts[p][v];
+        }
+    }
+    lutPending = true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Overload the = operator to easily set to netPBM images equal. The pixels
+ * are shared between the two images until one of them is changed, so no
+ * pixels are copied here.
+ *
+ * @param[in]  img - existing netPBM image.
+ *
+ * @returns the image that was assigned to.
+ *
+ * @par Example
+ * @verbatim
+   // img = img2;
+   @endverbatim
+ *****************************************************************************/
+netPBM& netPBM::operator=( const netPBM& img )
+{
+    if ( this == &img )
+    {
+        return *this;
+    }
+
+    // Release the current pixels and share the other image's block.
+    freeImage();
+    if ( img.block != nullptr )
+    {
+        img.block->refCount++;
+    }
+
+    // Get private data.
+    comments = img.comments;
+    rows = img.rows;
+    cols = img.cols;
+    stride = img.stride;
+    block = img.block;
+    redGray = img.redGray;
+    green = img.green;
+    blue = img.blue;
+    memcpy( luts, img.luts, sizeof( luts ) );
+    lutPending = img.lutPending;
+
+    return *this;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Overload the = operator to move one netPBM image into another. The pixel
+ * block is handed over instead of copied and the moved from image is left
+ * empty.
+ *
+ * @param[in,out]  img - netPBM image that is no longer needed.
+ *
+ * @returns the image that was assigned to.
+ *
+ * @par Example
+ * @verbatim
+   // img = move( img2 );
+   @endverbatim
+ *****************************************************************************/
+netPBM& netPBM::operator=( netPBM&& img )
+{
+    if ( this == &img )
+    {
+        return *this;
+    }
+
+    // Empty this image, then trade places with the other one.
+    freeImage();
+    comments.clear();
+
+    swap( comments, img.comments );
+    swap( rows, img.rows );
+    swap( cols, img.cols );
+    swap( stride, img.stride );
+    swap( block, img.block );
+    swap( redGray, img.redGray );
+    swap( green, img.green );
+    swap( blue, img.blue );
+    memcpy( luts, img.luts, sizeof( luts ) );
+    lutPending = img.lutPending;
+    img.clearLuts();
+
+    return *this;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Overload the == operator to check if two netPBM images are equal.
+ * Pointwise changes still waiting in the lookup tables of either image are
+ * applied to a copy of each row as it is compared, so neither image is
+ * changed.
+ *
+ * @param[in]  img - netPBM to compare with.
+ *
+ * @returns true if equal, false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( img == img2 )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::operator==( const netPBM& img ) const
+{
+    int i;
+    int p;
+    const pixel* mine;
+    const pixel* theirs;
+    vector<pixel> myRow;
+    vector<pixel> theirRow;
+
+    // Check to see if rows and cols are the same.
+    if ( (rows != img.rows) || (cols != img.cols) )
+    {
+        return false;
+    }
+
+    // Images sharing the same pixels and tables are always equal.
+    if ( ( redGray == img.redGray ) &&
+        ( memcmp( luts, img.luts, sizeof( luts ) ) == 0 ) )
+    {
+        return true;
+    }
+
+    // Run through the rows to see if each pixel is the same.
+    const pixel* planes[3] = { redGray, green, blue };
+    const pixel* imgPlanes[3] = { img.redGray, img.green, img.blue };
+    myRow.resize( cols );
+    theirRow.resize( cols );
+    for ( i = 0; i < rows; i++ )
+    {
+        for ( p = 0; p < 3; p++ )
+        {
+            mine = planes[p] + ( size_t ) i * stride;
+            theirs = imgPlanes[p] + ( size_t ) i * img.stride;
+            if ( lutPending )
+            {
+                memcpy( myRow.data(), mine, cols );
+                applyLut( myRow.data(), cols, luts[p] );
+                mine = myRow.data();
+            }
+            if ( img.lutPending )
+            {
+                memcpy( theirRow.data(), theirs, cols );
+                applyLut( theirRow.data(), cols, img.luts[p] );
+                theirs = theirRow.data();
+            }
+            if ( memcmp( mine, theirs, cols ) != 0 )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Overload the != operator to easily check if two netPBM images are not 
+ * equal.
+ *
+ * @param[in]  img - netPBM image to compare.
+ *
+ * @returns true if successful and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( img != img2 )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::operator!=( const netPBM& img ) const
 {
     return !( *this == img );
 }
@@ -717,7 +1683,8 @@ void netPBM::outputHeader( ofstream& fout, string magicNum )
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P3 .ppm image.
+ * Read in the data from a P3 .ppm image. The rest of the file is read into
+ * memory in large blocks and parsed with parseAscii.
  *
  * @param[in,out]  fin - input file to read from
  *
@@ -728,25 +1695,19 @@ void netPBM::outputHeader( ofstream& fout, string magicNum )
  *****************************************************************************/
 void netPBM::readAscii( ifstream& fin )
 {
-    int i;
-    int j;
-    int temp_value;
+    size_t size;
+    vector<pixel> text;
 
-    // Read ascii values into the image arrays.
-    for ( i = 0; i < rows; i++ )
+    // Read the rest of the file in blocks.
+    size = 0;
+    do
     {
-        for ( j = 0; j < cols; j++ )
-        {
-            fin >> temp_value;
-            redGray[i][j] = temp_value;
+        text.resize( size + READ_BLOCK_SIZE );
+        fin.read( ( char* ) text.data() + size, READ_BLOCK_SIZE );
+        size += ( size_t ) fin.gcount();
+    } while ( fin );
 
-            fin >> temp_value;
-            green[i][j] = temp_value;
-
-            fin >> temp_value;
-            blue[i][j] = temp_value;
-        }
-    }
+    parseAscii( text.data(), text.data() + size );
 }
 
 
@@ -755,7 +1716,10 @@ void netPBM::readAscii( ifstream& fin )
  * @author Aidan Justice
  *
  * @par Description
- * Read in the data from a P6 .ppm image.
+ * Read in the data from a P6 .ppm image. The raster is read in blocks of
+ * whole rows, about READ_BLOCK_SIZE bytes at a time, and each row is split
+ * into the color planes with deinterleaveRGB. If the file is cut short, the
+ * missing pixels are set to 0.
  *
  * @param[in,out]  fin - input file to read from
  *
@@ -767,16 +1731,65 @@ void netPBM::readAscii( ifstream& fin )
 void netPBM::readBinary( ifstream& fin )
 {
     int i;
-    int j;
+    int k;
+    int blockRows;
+    int whole;
+    size_t rowBytes;
+    size_t got;
+    vector<pixel> buffer;
+
+    if ( ( rows == 0 ) || ( cols == 0 ) )
+    {
+        return;
+    }
 
-    // Read binary values into the image arrays.
-    for ( i = 0; i < rows; i++ )
+    // Read as many whole rows at a time as fit in a block.
+    rowBytes = 3 * ( size_t ) cols;
+    blockRows = ( int ) ( READ_BLOCK_SIZE / rowBytes );
+    if ( blockRows < 1 )
     {
-        for ( j = 0; j < cols; j++ )
+        blockRows = 1;
+    }
+    if ( blockRows > rows )
+    {
+        blockRows = rows;
+    }
+    buffer.resize( rowBytes * blockRows );
+
+    for ( i = 0; i < rows; i += blockRows )
+    {
+        if ( i + blockRows > rows )
+        {
+            blockRows = rows - i;
+        }
+
+        fin.read( ( char* ) buffer.data(), rowBytes * blockRows );
+        got = ( size_t ) fin.gcount();
+
+        // Split each row, zeroing whatever the file is missing.
+        for ( k = 0; k < blockRows; k++ )
         {
-            fin.read( ( char* ) &redGray[i][j], sizeof( pixel ) );
-            fin.read( ( char* ) &green[i][j], sizeof( pixel ) );
-            fin.read( ( char* ) &blue[i][j], sizeof( pixel ) );
+            whole = 0;
+            if ( got > k * rowBytes )
+            {
+                whole = ( int ) ( ( got - k * rowBytes ) / 3 );
+                if ( whole > cols )
+                {
+                    whole = cols;
+                }
+            }
+
+            deinterleaveRGB( buffer.data() + k * rowBytes,
+                redGray + ( size_t ) ( i + k ) * stride,
+                green + ( size_t ) ( i + k ) * stride,
+                blue + ( size_t ) ( i + k ) * stride, whole );
+
+            if ( whole < cols )
+            {
+                memset( redGray + ( size_t ) ( i + k ) * stride + whole, 0, cols - whole );
+                memset( green + ( size_t ) ( i + k ) * stride + whole, 0, cols - whole );
+                memset( blue + ( size_t ) ( i + k ) * stride + whole, 0, cols - whole );
+            }
         }
     }
 }
@@ -787,31 +1800,222 @@ void netPBM::readBinary( ifstream& fin )
  * @author Aidan Justice
  *
  * @par Description
- * Read in the header from any .ppm image.
- *
- * @param[in,out]  fin - input file to read from.
+ * Read in the header from any .ppm image.
+ *
+ * @param[in,out]  fin - input file to read from.
+ *
+ * @par Example
+ * @verbatim
+   // img.readHeader( fin );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::readHeader( ifstream& fin )
+{
+    string garbage;
+    string comment;
+
+    while ( fin.peek() == '#' )
+    {
+        getline( fin, comment );
+        comments += comment + '\n';
+    }
+
+    fin >> cols;
+    fin >> rows;
+
+    fin >> garbage;
+    fin.ignore();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Reads in the image data from a .ppm image. Files that can be memory mapped
+ * are read with readMappedImage, anything else is read through a stream.
+ *
+ * @param[in]    filename - name of the file to be opened and read in.
+ *
+ * @returns true if successful and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   // if ( !img.readInImage( filename ) )
+   @endverbatim
+ *****************************************************************************/
+bool netPBM::readInImage( string filename )
+{
+    ifstream fin;
+    string magicNum;
+    string garbage;
+
+    // A new image has no pointwise changes waiting.
+    clearLuts();
+
+    // Read straight out of a memory mapped file when possible.
+    if ( readMappedImage( filename ) )
+    {
+        return true;
+    }
+
+    // Open file and check for success.
+    fin.open( filename, ios::in | ios::binary );
+    if ( !fin.is_open() )
+    {
+        return false;
+    }
+
+    // Read in magic number and validate it is appropriate.
+    fin >> magicNum;
+    if ((magicNum != "P3") && (magicNum != "P6"))
+    {
+        return false;
+    }
+    fin.ignore();
+
+    comments.clear();
+    readHeader( fin );
+
+    // Check the size was read and is not too big, the same as parseHeader.
+    if ( !fin || ( rows < 0 ) || ( cols < 0 ) || ( rows > INT_MAX / 3 ) ||
+        ( cols > INT_MAX / 3 ) )
+    {
+        freeImage();
+        return false;
+    }
+
+    // Allocate the planes and check for success.
+    if ( !allocImage( rows, cols ) )
+    {
+        return false;
+    }
+
+    // Read in image data.
+    if ( magicNum == "P3" )
+    {
+        readAscii( fin );
+    }
+    else
+    {
+        readBinary( fin );
+    }
+
+    fin.close();
+    return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets all of the blue pixels to 0. The change is added to the lookup
+ * tables waiting to be applied, see applyLuts.
+ *
+ * @par Example
+ * @verbatim
+   // img.removeBlue();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::removeBlue()
+{
+    memset( luts[2], 0, 256 );
+    lutPending = true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets all of the green pixels to 0. The change is added to the lookup
+ * tables waiting to be applied, see applyLuts.
+ *
+ * @par Example
+ * @verbatim
+   // img.removeGreen();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::removeGreen()
+{
+    memset( luts[1], 0, 256 );
+    lutPending = true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets all of the red pixels to 0. The change is added to the lookup
+ * tables waiting to be applied, see applyLuts.
+ *
+ * @par Example
+ * @verbatim
+   // img.removeRed();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::removeRed()
+{
+    memset( luts[0], 0, 256 );
+    lutPending = true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Rotate the image clockwise 90 degrees. This is a transpose with one side
+ * flipped, done by transposePlane a cache sized tile at a time. The image is
+ * split into larger tiles that are done at the same time, see
+ * parallelTiles.
  *
  * @par Example
  * @verbatim
-   // img.readHeader( fin );
+   // img.rotateCW();
    @endverbatim
  *****************************************************************************/
-void netPBM::readHeader( ifstream& fin )
+void netPBM::rotateCW()
 {
-    string garbage;
-    string comment;
+    size_t last;
+    netPBM img;
 
-    while ( fin.peek() == '#' )
+    // Get a temporary image that shares the old values.
+    img = *this;
+
+    // Allocate new planes with the dimensions swapped, leaving the image as
+    // it was if there is no room for them.
+    if ( !allocImage( img.cols, img.rows ) )
     {
-        getline( fin, comment );
-        comments += comment + '\n';
+        *this = move( img );
+        return;
     }
 
-    fin >> cols;
-    fin >> rows;
-
-    fin >> garbage;
-    fin.ignore();
+    // Transpose the planes with the source rows read bottom up, a tile on
+    // each thread at a time.
+    last = ( size_t ) ( img.rows - 1 ) * img.stride;
+    parallelTiles( img.rows, img.cols, ROTATE_TILE, ROTATE_TILE,
+        [&]( int top, int left, int bottom, int right )
+        {
+            ptrdiff_t src;
+            size_t dest;
+
+            src = ( ptrdiff_t ) last - ( ptrdiff_t ) top * img.stride + left;
+            dest = ( size_t ) left * stride + top;
+            transposePlane( img.redGray + src, -img.stride, redGray + dest,
+                stride, bottom - top, right - left );
+            transposePlane( img.green + src, -img.stride, green + dest,
+                stride, bottom - top, right - left );
+            transposePlane( img.blue + src, -img.stride, blue + dest,
+                stride, bottom - top, right - left );
+        } );
 }
 
 
@@ -820,69 +2024,70 @@ void netPBM::readHeader( ifstream& fin )
  * @author Aidan Justice
  *
  * @par Description
- * Reads in the image data from a .ppm image.
- *
- * @param[in]    filename - name of the file to be opened and read in.
- *
- * @returns true if successful and false otherwise.
+ * Rotate the image counterclockwise 90 degrees. This is a transpose with one side
+ * flipped, done by transposePlane a cache sized tile at a time. The image is
+ * split into larger tiles that are done at the same time, see
+ * parallelTiles.
  *
  * @par Example
  * @verbatim
-   // if ( !img.readInImage( filename ) )
+   // img.rotateCCW();
    @endverbatim
  *****************************************************************************/
-bool netPBM::readInImage( string filename )
+void netPBM::rotateCCW()
 {
-    ifstream fin;
-    string magicNum;
-    string garbage;
+    size_t last;
+    netPBM img;
 
-    // Open file and check for success.
-    fin.open( filename, ios::in | ios::binary );
-    if ( !fin.is_open() )
-    {
-        return false;
-    }
+    // Get a temporary image that shares the old values.
+    img = *this;
 
-    // Read in magic number and validate it is appropriate.
-    fin >> magicNum;
-    if ((magicNum != "P3") && (magicNum != "P6"))
+    // Allocate new planes with the dimensions swapped, leaving the image as
+    // it was if there is no room for them.
+    if ( !allocImage( img.cols, img.rows ) )
     {
-        return false;
+        *this = move( img );
+        return;
     }
-    fin.ignore();
 
-    readHeader( fin );
+    // Transpose the planes with the new rows written bottom up, a tile on
+    // each thread at a time.
+    last = ( size_t ) ( rows - 1 ) * stride;
+    parallelTiles( img.rows, img.cols, ROTATE_TILE, ROTATE_TILE,
+        [&]( int top, int left, int bottom, int right )
+        {
+            size_t src;
+            ptrdiff_t dest;
+
+            src = ( size_t ) top * img.stride + left;
+            dest = ( ptrdiff_t ) last - ( ptrdiff_t ) left * stride + top;
+            transposePlane( img.redGray + src, img.stride, redGray + dest,
+                -stride, bottom - top, right - left );
+            transposePlane( img.green + src, img.stride, green + dest,
+                -stride, bottom - top, right - left );
+            transposePlane( img.blue + src, img.stride, blue + dest,
+                -stride, bottom - top, right - left );
+        } );
+}
 
-    // Allocate arrays and check for success.
-    redGray = alloc2d( rows, cols );
-    if (redGray == nullptr)
-    {
-        return false;
-    }
-    green = alloc2d( rows, cols );
-    if ( green == nullptr )
-    {
-        return false;
-    }
-    blue = alloc2d( rows, cols );
-    if ( blue == nullptr )
-    {
-        return false;
-    }
 
-    // Read in image data.
-    if ( magicNum == "P3" )
-    {
-        readAscii( fin );
-    }
-    else
-    {
-        readBinary( fin );
-    }
 
-    fin.close();
-    return true;
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sharpens the image. Each pixel becomes 5 times itself minus its four
+ * neighbors, cropped to 0 and 255. The pixels along the edges are set to 0.
+ * See applyStencil.
+ *
+ * @par Example
+ * @verbatim
+   // img.sharpen();
+   @endverbatim
+ *****************************************************************************/
+void netPBM::sharpen()
+{
+    applyStencil( sharpenRow );
 }
 
 
@@ -891,25 +2096,17 @@ bool netPBM::readInImage( string filename )
  * @author Aidan Justice
  *
  * @par Description
- * Set all blue values equal to 0.
+ * Smooths the image. Each pixel becomes the average of itself and its eight
+ * neighbors. The pixels along the edges are set to 0. See applyStencil.
  *
  * @par Example
  * @verbatim
-   // img.removeBlue();
+   // img.smooth();
    @endverbatim
  *****************************************************************************/
-void netPBM::removeBlue()
+void netPBM::smooth()
 {
-    int i;
-    int j;
-
-    for ( i = 0; i < rows; i++ )
-    {
-        for ( j = 0; j < cols; j++ )
-        {
-            blue[i][j] = 0;
-        }
-    }
+    applyStencil( smoothRow );
 }
 
 
@@ -918,25 +2115,43 @@ void netPBM::removeBlue()
  * @author Aidan Justice
  *
  * @par Description
- * Set all green values equal to 0.
+ * Stretches the gray plane so low becomes 0 and high becomes 255. Every
+ * pixel is between low and high, so the new value of each of those is
+ * worked out once with the double math contrast has always used and added
+ * to the gray lookup table waiting to be applied. If every pixel is the
+ * same they all become 0.
+ *
+ * @param[in]  low - smallest gray value in the image.
+ * @param[in]  high - largest gray value in the image.
  *
  * @par Example
  * @verbatim
-   // img.removeGreen();
+   // stretchGray( low, high );
    @endverbatim
  *****************************************************************************/
-void netPBM::removeGreen()
+void netPBM::stretchGray( pixel low, pixel high )
 {
-    int i;
-    int j;
+    int v;
+    double scale;
+    pixel lut[256];
 
-    for ( i = 0; i < rows; i++ )
+    // Build the table, values outside of low to high never show up.
+    scale = 255.0 / ( high - low );
+    for ( v = 0; v < 256; v++ )
     {
-        for ( j = 0; j < cols; j++ )
+        lut[v] = 0;
+        if ( ( v > low ) && ( v <= high ) )
         {
-            green[i][j] = 0;
+            lut[v] = ( pixel ) ( scale * ( v - low ) );
         }
     }
+
+    // Run the gray values through it after the tables already waiting.
+    for ( v = 0; v < 256; v++ )
+    {
+        luts[RED_GRAY][v] = lut[luts[RED_GRAY][v]];
+    }
+    lutPending = true;
 }
 
 
@@ -945,25 +2160,70 @@ void netPBM::removeGreen()
  * @author Aidan Justice
  *
  * @par Description
- * Set all red values equal to 0.
+ * Gets a view of a rectangle of the image. The view shares the pixels of
+ * this image and only points at where the rectangle starts in each plane,
+ * keeping this image's stride, so making one takes the same time no matter
+ * how big it is. Either image copies the pixels before it changes them, the
+ * same as any other shared image. A window bigger than the image is cut
+ * down to the image's size and one that hangs off the bottom or right is
+ * moved back inside.
+ *
+ * @param[in]  row - starting row of the view.
+ * @param[in]  col - starting column of the view.
+ * @param[in]  height - number of rows in the view.
+ * @param[in]  width - number of columns in the view.
+ *
+ * @returns an image that views the rectangle.
  *
  * @par Example
  * @verbatim
-   // img.removeRed();
+   // tile = img.view( 64, 128, 32, 32 );
    @endverbatim
  *****************************************************************************/
-void netPBM::removeRed()
+netPBM netPBM::view( int row, int col, int height, int width ) const
 {
-    int i;
-    int j;
+    size_t offset;
+    netPBM part;
 
-    for ( i = 0; i < rows; i++ )
+    // Check to see if height and width are too big.
+    if ( height > rows )
     {
-        for ( j = 0; j < cols; j++ )
-        {
-            redGray[i][j] = 0;
-        }
+        height = rows;
+        row = 0;
+    }
+    if ( width > cols )
+    {
+        width = cols;
+        col = 0;
+    }
+    height = height < 0 ? 0 : height;
+    width = width < 0 ? 0 : width;
+
+    // Get an appropriate starting point.
+    if ( ( height + row ) > rows )
+    {
+        row = rows - height;
+    }
+    if ( ( width + col ) > cols )
+    {
+        col = cols - width;
     }
+    row = row < 0 ? 0 : row;
+    col = col < 0 ? 0 : col;
+
+    // Share the pixels and move the planes to the corner of the window.
+    part = *this;
+    offset = ( size_t ) row * stride + col;
+    part.rows = height;
+    part.cols = width;
+    if ( part.block != nullptr )
+    {
+        part.redGray += offset;
+        part.green += offset;
+        part.blue += offset;
+    }
+
+    return part;
 }
 
 
@@ -972,44 +2232,24 @@ void netPBM::removeRed()
  * @author Aidan Justice
  *
  * @par Description
- * Rotate the image clockwise 90 degrees.
+ * Write out the data of a P3 .ppm image. The rows are formatted on all the
+ * threads of the pool and written in order, see writeTextRows.
+ *
+ * @param[in,out]  fout - output file to write to.
+ * @param[in]      packed - true to fill lines up to ASCII_LINE_LENGTH, false
+ *                          to put each pixel on its own line.
  *
  * @par Example
  * @verbatim
-   // img.rotateCW();
+   // img.writeAscii( fout, false );
    @endverbatim
  *****************************************************************************/
-void netPBM::rotateCW()
+void netPBM::writeAscii( ofstream& fout, bool packed )
 {
-    int i;
-    int j;
-    netPBM img;
-
-    // Create temporary image.
-    img = *this;
-
-    // Free old arrays.
-    free2d( redGray, rows );
-    free2d( green, rows );
-    free2d( blue, rows );
-
-    swap( rows, cols );
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
 
-    // Allocate new arrays.
-    redGray = alloc2d( rows, cols );
-    green = alloc2d( rows, cols );
-    blue = alloc2d( rows, cols );
-
-    // Fill new arrays.
-    for ( i = 0; i < img.rows; i++ )
-    {
-        for ( j = 0; j < img.cols; j++ )
-        {
-            redGray[j][cols - 1 - i] = img.redGray[i][j];
-            green[j][cols - 1 - i] = img.green[i][j];
-            blue[j][cols - 1 - i] = img.blue[i][j];
-        }
-    }
+    writeTextRows( fout, packed, false );
 }
 
 
@@ -1018,43 +2258,62 @@ void netPBM::rotateCW()
  * @author Aidan Justice
  *
  * @par Description
- * Rotate the image counterclockwise 90 degrees.
+ * Write out the data of a P6 .ppm image. Rows are interleaved into a buffer
+ * with interleaveRGB and the buffer is written about WRITE_BLOCK_SIZE bytes
+ * at a time.
+ *
+ * @param[in,out]  fout - output file to write to.
  *
  * @par Example
  * @verbatim
-   // img.rotateCCW();
+   // img.writeBinary( fout );
    @endverbatim
  *****************************************************************************/
-void netPBM::rotateCCW()
+void netPBM::writeBinary( ofstream& fout )
 {
     int i;
-    int j;
-    netPBM img;
-
-    // Create temporary image.
-    img = *this;
+    int k;
+    int blockRows;
+    size_t rowBytes;
+    vector<pixel> buffer;
 
-    // Free old arrays.
-    free2d( redGray, rows );
-    free2d( green, rows );
-    free2d( blue, rows );
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
 
-    swap( rows, cols );
+    if ( ( rows == 0 ) || ( cols == 0 ) )
+    {
+        return;
+    }
 
-    // Allocate new arrays.
-    redGray = alloc2d( rows, cols );
-    green = alloc2d( rows, cols );
-    blue = alloc2d( rows, cols );
+    // Gather as many whole rows at a time as fit in a block.
+    rowBytes = 3 * ( size_t ) cols;
+    blockRows = ( int ) ( WRITE_BLOCK_SIZE / rowBytes );
+    if ( blockRows < 1 )
+    {
+        blockRows = 1;
+    }
+    if ( blockRows > rows )
+    {
+        blockRows = rows;
+    }
+    buffer.resize( rowBytes * blockRows );
 
-    // Fill new arrays.
-    for ( i = 0; i < img.rows; i++ )
+    for ( i = 0; i < rows; i += blockRows )
     {
-        for ( j = 0; j < img.cols; j++ )
+        if ( i + blockRows > rows )
+        {
+            blockRows = rows - i;
+        }
+
+        for ( k = 0; k < blockRows; k++ )
         {
-            redGray[rows - 1 - j][i] = img.redGray[i][j];
-            green[rows - 1 - j][i] = img.green[i][j];
-            blue[rows - 1 - j][i] = img.blue[i][j];
+            interleaveRGB( redGray + ( size_t ) ( i + k ) * stride,
+                green + ( size_t ) ( i + k ) * stride,
+                blue + ( size_t ) ( i + k ) * stride,
+                buffer.data() + k * rowBytes, cols );
         }
+
+        fout.write( ( char* ) buffer.data(), rowBytes * blockRows );
     }
 }
 
@@ -1064,54 +2323,25 @@ void netPBM::rotateCCW()
  * @author Aidan Justice
  *
  * @par Description
- * Sharpens the image. Creates a temporary image and sets it equal to the 
- * original, then computes each pixels sharpened values.
+ * Write out the data of a P2 .pgm image from the gray plane. The rows are
+ * formatted on all the threads of the pool and written in order, see
+ * writeTextRows.
+ *
+ * @param[in,out]  fout - output file to write to.
+ * @param[in]      packed - true to fill lines up to ASCII_LINE_LENGTH, false
+ *                          to put each pixel on its own line.
  *
  * @par Example
  * @verbatim
-   // img.sharpen();
+   // img.writeGrayAscii( fout, false );
    @endverbatim
  *****************************************************************************/
-void netPBM::sharpen()
+void netPBM::writeGrayAscii( ofstream& fout, bool packed )
 {
-    int i;
-    int j;
-    int temp_value;
-    netPBM temp;
-
-    temp = *this;
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
 
-    for ( i = 0; i < rows; i++ )
-    {
-        for ( j = 0; j < cols; j++ )
-        {
-            // Set border pixels to 0;
-            if ( ( i == 0 ) || ( i == rows - 1 ) || ( j == 0 ) || ( j == cols - 1 ) )
-            {
-                redGray[i][j] = 0;
-                green[i][j] = 0;
-                blue[i][j] = 0;
-            }
-            // Compute sharpened values for others.
-            else 
-            {
-                temp_value = ( 5 * temp.redGray[i][j] ) - temp.redGray[i - 1][j]
-                    - temp.redGray[i + 1][j] - temp.redGray[i][j - 1] 
-                    - temp.redGray[i][j + 1];
-                redGray[i][j] = cropRound( temp_value );
-
-                temp_value = ( 5 * temp.green[i][j] ) - temp.green[i - 1][j]
-                    - temp.green[i + 1][j] - temp.green[i][j - 1]
-                    - temp.green[i][j + 1];
-                green[i][j] = cropRound( temp_value );
-                
-                temp_value = ( 5 * temp.blue[i][j] ) - temp.blue[i - 1][j]
-                    - temp.blue[i + 1][j] - temp.blue[i][j - 1]
-                    - temp.blue[i][j + 1];
-                blue[i][j] = cropRound( temp_value );
-            }
-        }
-    }
+    writeTextRows( fout, packed, true );
 }
 
 
@@ -1120,59 +2350,65 @@ void netPBM::sharpen()
  * @author Aidan Justice
  *
  * @par Description
- * Smooths the image. Creates a temporary image and sets it equal to original
- * image, then computes each smoothed value.
+ * Write out the data of a P5 .pgm image. The padding at the end of each row
+ * is dropped while rows are gathered into a buffer, and the buffer is
+ * written about WRITE_BLOCK_SIZE bytes at a time.
+ *
+ * @param[in,out]  fout - output file to write to.
  *
  * @par Example
  * @verbatim
-   // img.smooth();
+   // img.writeGrayBinary( fout );
    @endverbatim
  *****************************************************************************/
-void netPBM::smooth()
+void netPBM::writeGrayBinary( ofstream& fout )
 {
     int i;
-    int j;
-    int temp_value;
-    netPBM temp;
+    int k;
+    int blockRows;
+    vector<pixel> buffer;
 
-    temp = *this;
+    // Apply any pointwise changes still waiting in the lookup tables.
+    applyLuts();
 
-    for ( i = 0; i < rows; i++ )
+    if ( ( rows == 0 ) || ( cols == 0 ) )
+    {
+        return;
+    }
+
+    // The planes are stored without gaps when there is no padding.
+    if ( stride == cols )
+    {
+        fout.write( ( char* ) redGray, ( size_t ) rows * cols );
+        return;
+    }
+
+    // Gather as many whole rows at a time as fit in a block.
+    blockRows = WRITE_BLOCK_SIZE / cols;
+    if ( blockRows < 1 )
+    {
+        blockRows = 1;
+    }
+    if ( blockRows > rows )
+    {
+        blockRows = rows;
+    }
+    buffer.resize( ( size_t ) cols * blockRows );
+
+    for ( i = 0; i < rows; i += blockRows )
     {
-        for ( j = 0; j < cols; j++ )
+        if ( i + blockRows > rows )
         {
-            // Set borders to 0.
-            if ( ( i == 0 ) || ( i == rows - 1 ) || ( j == 0 ) || ( j == cols - 1 ) )
-            {
-                redGray[i][j] = 0;
-                green[i][j] = 0;
-                blue[i][j] = 0;
-            }
-            // Calculate smoothed values for each pixel.
-            else
-            {
-                temp_value = ( temp.redGray[i][j] + temp.redGray[i - 1][j - 1]
-                    + temp.redGray[i - 1][j] + temp.redGray[i - 1][j + 1]
-                    + temp.redGray[i][j - 1] + temp.redGray[i][j + 1]
-                    + temp.redGray[i + 1][j] + temp.redGray[i + 1][j - 1]
-                    + temp.redGray[i + 1][j + 1] ) / 9;
-                redGray[i][j] = cropRound( temp_value );
-
-                temp_value = ( temp.green[i][j] + temp.green[i - 1][j - 1]
-                    + temp.green[i - 1][j] + temp.green[i - 1][j + 1]
-                    + temp.green[i][j - 1] + temp.green[i][j + 1]
-                    + temp.green[i + 1][j] + temp.green[i + 1][j - 1]
-                    + temp.green[i + 1][j + 1] ) / 9;
-                green[i][j] = cropRound( temp_value );
-
-                temp_value = ( temp.blue[i][j] + temp.blue[i - 1][j - 1]
-                    + temp.blue[i - 1][j] + temp.blue[i - 1][j + 1]
-                    + temp.blue[i][j - 1] + temp.blue[i][j + 1]
-                    + temp.blue[i + 1][j] + temp.blue[i + 1][j - 1]
-                    + temp.blue[i + 1][j + 1] ) / 9;
-                blue[i][j] = cropRound( temp_value );
-            }
+            blockRows = rows - i;
+        }
+
+        for ( k = 0; k < blockRows; k++ )
+        {
+            memcpy( buffer.data() + ( size_t ) k * cols,
+                redGray + ( size_t ) ( i + k ) * stride, cols );
         }
+
+        fout.write( ( char* ) buffer.data(), ( size_t ) cols * blockRows );
     }
 }
 
@@ -1185,7 +2421,8 @@ void netPBM::smooth()
  * Write out a grayscaled image to a .pgm file.
  *
  * @param[in]  filename - file to be opened and written to.
- * @param[in]  out - specifies whether to write in binary or ascii.
+ * @param[in]  out - specifies whether to write in binary, ascii or packed
+ *                   ascii.
  *
  * @returns true if successful and false otherwise.
  *
@@ -1196,8 +2433,6 @@ void netPBM::smooth()
  *****************************************************************************/
 bool netPBM::writeOutGrayImage( string filename, outputType out )
 {
-    int i;
-    int j;
     ofstream fout;
 
     // Open file and check for success.
@@ -1208,30 +2443,16 @@ bool netPBM::writeOutGrayImage( string filename, outputType out )
     }
 
     // Output to ascii.
-    if ( out == ASCII )
+    if ( out != RAW )
     {
         outputHeader( fout, "P2" );
-
-        for ( i = 0; i < rows; i++ )
-        {
-            for ( j = 0; j < cols; j++ )
-            {
-                fout << ( int ) redGray[i][j] << endl;
-            }
-        }
+        writeGrayAscii( fout, out == PACKED_ASCII );
     }
     // Output to binary.
     else
     {
         outputHeader( fout, "P5" );
-
-        for ( i = 0; i < rows; i++ )
-        {
-            for ( j = 0; j < cols; j++ )
-            {
-                fout.write( ( char* ) &redGray[i][j], sizeof( pixel ) );
-            }
-        }
+        writeGrayBinary( fout );
     }
 
     fout.close();
@@ -1247,7 +2468,8 @@ bool netPBM::writeOutGrayImage( string filename, outputType out )
  * Write out an image to a .ppm file.
  *
  * @param[in]  filename - file to be opened and written to.
- * @param[in]  out - specifies whether to write in binary or ascii.
+ * @param[in]  out - specifies whether to write in binary, ascii or packed
+ *                   ascii.
  *
  * @returns true if successful and false otherwise.
  *
@@ -1258,8 +2480,6 @@ bool netPBM::writeOutGrayImage( string filename, outputType out )
  *****************************************************************************/
 bool netPBM::writeOutImage( string filename, outputType out )
 {
-    int i;
-    int j;
     ofstream fout;
 
     // Open file and check for success.
@@ -1270,38 +2490,107 @@ bool netPBM::writeOutImage( string filename, outputType out )
     }
 
     // Output to ascii.
-    if (out == ASCII)
+    if ( out != RAW )
     {
         outputHeader( fout, "P3" );
-
-        // Write each color value to file in ascii.
-        for ( i = 0; i < rows; i++ )
-        {
-            for ( j = 0; j < cols; j++ )
-            {
-                fout << ( int )redGray[i][j] << " ";
-                fout << ( int )green[i][j] << " ";
-                fout << ( int )blue[i][j] << endl;
-            }
-        }
+        writeAscii( fout, out == PACKED_ASCII );
     }
     // Output to binary.
     else
     {
         outputHeader( fout, "P6" );
-
-        // Write each color value to file in binary.
-        for ( i = 0; i < rows; i++ )
-        {
-            for ( j = 0; j < cols; j++ )
-            {
-                fout.write( ( char* ) &redGray[i][j], sizeof( pixel ) );
-                fout.write( ( char* ) &green[i][j], sizeof( pixel ) );
-                fout.write( ( char* ) &blue[i][j], sizeof( pixel ) );
-            }
-        }
+        writeBinary( fout );
     }
 
     fout.close();
     return true;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Formats the rows of the image as P3 or P2 text and writes them out. Each
+ * thread of the pool has its own buffer and formats a block of as many
+ * whole rows as fit in about WRITE_BLOCK_SIZE bytes into it with
+ * formatAsciiRow. Once every thread has filled its buffer they are written
+ * in the order of their rows and the threads go on to the next blocks, so
+ * the text comes out the same as formatting the rows one after another.
+ *
+ * @param[in,out]  fout - output file to write to.
+ * @param[in]      packed - true to fill lines up to ASCII_LINE_LENGTH, false
+ *                          to put each pixel on its own line.
+ * @param[in]      gray - true to write only the gray plane.
+ *
+ * @par Example
+ * @verbatim
+   // writeTextRows( fout, packed, false );
+   @endverbatim
+ *****************************************************************************/
+void netPBM::writeTextRows( ofstream& fout, bool packed, bool gray )
+{
+    int b;
+    int i;
+    int blocks;
+    int blockRows;
+    size_t rowBytes;
+    vector<vector<char>> buffers;
+    vector<size_t> lengths;
+
+    if ( ( rows == 0 ) || ( cols == 0 ) )
+    {
+        return;
+    }
+
+    // Format as many whole rows at a time as fit in a block.
+    rowBytes = ASCII_BYTES_PER_PIXEL * ( size_t ) cols;
+    blockRows = ( int ) ( WRITE_BLOCK_SIZE / rowBytes );
+    if ( blockRows < 1 )
+    {
+        blockRows = 1;
+    }
+    if ( blockRows > rows )
+    {
+        blockRows = rows;
+    }
+
+    // One block for each thread, but no more than there are rows for.
+    blocks = min( threadPool::global().getThreads(),
+        ( rows + blockRows - 1 ) / blockRows );
+    buffers.resize( blocks );
+    lengths.resize( blocks );
+    for ( b = 0; b < blocks; b++ )
+    {
+        buffers[b].resize( rowBytes * blockRows );
+    }
+
+    for ( i = 0; i < rows; i += blocks * blockRows )
+    {
+        threadPool::global().run( blocks, [&]( int part )
+            {
+                int k;
+                int first;
+                int last;
+
+                first = i + part * blockRows;
+                last = min( first + blockRows, rows );
+                lengths[part] = 0;
+                for ( k = first; k < last; k++ )
+                {
+                    lengths[part] += formatAsciiRow(
+                        redGray + ( size_t ) k * stride,
+                        gray ? nullptr : green + ( size_t ) k * stride,
+                        gray ? nullptr : blue + ( size_t ) k * stride, cols,
+                        packed, buffers[part].data() + lengths[part] );
+                }
+            } );
+
+        // Write the blocks out in the order of their rows.
+        for ( b = 0; b < blocks; b++ )
+        {
+            fout.write( buffers[b].data(), lengths[b] );
+        }
+    }
 }
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <cstring>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 using namespace std;
 
 #ifndef __NETPBM__H__
@@ -19,22 +26,304 @@ typedef unsigned char pixel;
 
 
 /**
-* @brief Holds the data for .ppm and .pgm images.
+* @brief Every row of an image plane starts on a multiple of this many bytes
+*        and the stride between rows is padded to a multiple of it.
+*/
+const int ROW_ALIGN = 64;
+
+
+/**
+* @brief Vector instruction sets the pixel kernels can use, returned or'ed
+*        together by cpuFeatures.
+*/
+enum cpuFeature
+{
+    CPU_SSE2 = 1,       /**< SSE2 128 bit integer instructions               */
+    CPU_SSSE3 = 2,      /**< SSSE3 byte shuffles                             */
+    CPU_AVX2 = 4,       /**< AVX2 256 bit integer instructions               */
+    CPU_AVX512 = 8,     /**< AVX-512 F and BW 512 bit byte instructions      */
+    CPU_VBMI = 16       /**< AVX-512 VBMI byte permutes                      */
+};
+
+
+/**
+* @brief Number of bytes read from a stream at a time when reading a binary
+*        raster.
+*/
+const int READ_BLOCK_SIZE = 1024 * 1024;
+
+
+/**
+* @brief Number of bytes gathered before each write to a stream when writing
+*        a binary raster.
+*/
+const int WRITE_BLOCK_SIZE = 1024 * 1024;
+
+
+/**
+* @brief Fewest bytes of P3 text given to a thread to parse. The text of
+*        smaller images is parsed on a single thread.
+*/
+const int PARSE_CHUNK_SIZE = 1024 * 1024;
+
+
+/**
+* @brief Longest line written in the packed ascii layout, the limit the
+*        netPBM formats set.
+*/
+const int ASCII_LINE_LENGTH = 70;
+
+
+/**
+* @brief Most bytes of text a pixel can take in an ascii image, 3 samples of
+*        3 digits each followed by a space or a newline.
+*/
+const int ASCII_BYTES_PER_PIXEL = 12;
+
+
+/**
+* @brief Fixed point reciprocal of 10. For every n up to 2550, the largest
+*        3r + 6g + b can be, ( n * GRAY_RECIPROCAL ) >> 16 equals n / 10.
+*/
+const unsigned int GRAY_RECIPROCAL = 6554;
+
+
+/**
+* @brief Fixed point reciprocal of 9. For every n up to 2295, the largest sum
+*        of nine pixels, ( n * SMOOTH_RECIPROCAL ) >> 16 equals n / 9.
+*/
+const unsigned int SMOOTH_RECIPROCAL = 7282;
+
+
+/**
+* @brief Side of the square tiles a plane is transposed in. A tile of source
+*        rows and a tile of dest rows take 8 KiB together, well inside the
+*        L1 cache.
+*/
+const int TRANSPOSE_TILE = 64;
+
+
+/**
+* @brief Fewest rows handed to a thread at once. Splitting up fewer rows
+*        costs more in waking threads than it saves.
+*/
+const int BAND_ROWS = 16;
+
+
+/**
+* @brief Most threads the pool starts for each processor. Any more only wait
+*        on each other and each one holds its own pixelArena.
+*/
+const int THREADS_PER_PROCESSOR = 4;
+
+
+/**
+* @brief Most rows in a tile of the stencil and blur operations.
+*/
+const int TILE_ROWS = 64;
+
+
+/**
+* @brief Most columns in a tile of the stencil and blur operations. Tiles are
+*        kept wide so the row kernels run over long stretches of pixels.
+*/
+const int TILE_COLS = 1024;
+
+
+/**
+* @brief Side of the square tiles a rotation is split into between threads,
+*        each transposed TRANSPOSE_TILE pixels at a time.
+*/
+const int ROTATE_TILE = 4 * TRANSPOSE_TILE;
+
+
+/**
+* @brief Weights of a convolution kernel, read from a kernel file or the
+*        command line. The center weight lines up with the pixel being
+*        worked out.
+*/
+struct convKernel
+{
+    int height;              /**< Number of rows of weights, odd              */
+    int width;               /**< Number of columns of weights, odd           */
+    vector<double> weights;  /**< height * width weights, row by row          */
+    double divisor;          /**< The weighted sum is divided by this         */
+};
+
+
+/**
+* @brief Block of pixels that can be shared between several netPBM images.
+*        It is only copied when one of the images sharing it is changed.
+*/
+struct pixelBlock
+{
+    atomic<int> refCount; /**< Number of images using this block          */
+    size_t size;          /**< Number of bytes in data                     */
+    pixel *data;          /**< Holds all three color planes of an image    */
+};
+
+
+/**
+* @brief Pool of image sized buffers kept by each thread. Buffers given back
+*        to the pool are handed out again to later images and operations
+*        instead of being freed, so a chain of operations or a batch of
+*        images does not keep page faulting in fresh memory.
+*/
+class pixelArena
+{
+    public:
+        pixelArena();
+        ~pixelArena();
+
+        pixel* acquire( size_t size, size_t& capacity );
+        void release( pixel* data, size_t capacity );
+        void clear();
+
+        static pixelArena& local();
+        static void useHugePages( bool enable );
+        static void setLimit( size_t bytes );
+
+    protected:
+        pixel* allocBuffer( size_t& capacity );
+        void freeBuffer( pixel* data );
+
+    private:
+        /**
+        * @brief A buffer waiting in the pool to be handed out again.
+        */
+        struct freeBlock
+        {
+            pixel *data;     /**< Start of the buffer                     */
+            size_t capacity; /**< Number of bytes in the buffer           */
+        };
+
+        vector<freeBlock> pool;  /**< Buffers ready to be handed out      */
+        size_t heldBytes;        /**< Total bytes sitting in the pool     */
+
+        static atomic<bool> hugePages;  /**< Back large buffers with huge pages */
+        static atomic<size_t> limit;    /**< Most bytes a pool will hold        */
+};
+
+
+/**
+* @brief Threads that are started once and then kept waiting for work. Each
+*        netPBM operation splits its rows into bands or its planes into
+*        tiles and hands them to the pool, see parallelRows and
+*        parallelTiles. Threads that run out of work steal it from the
+*        others. The global pool is shared by the whole program, so only
+*        one thread hands it a job at a time, any other runs its tasks
+*        itself.
+*/
+class threadPool
+{
+    public:
+        threadPool();
+        ~threadPool();
+
+        void run( int tasks, const function<void( int )>& task );
+        int getThreads() const;
+        void setThreads( int count );
+
+        static threadPool& global();
+
+    protected:
+        int takeTask( int self );
+        void workerLoop( int self, unsigned long seen );
+        void stopWorkers();
+
+    private:
+        /**
+        * @brief Tasks a thread has left, the first in the high 32 bits and
+        *        the one just past the last in the low 32 bits. Each takes up
+        *        a whole cache line so threads taking tasks don't slow each
+        *        other down.
+        */
+        struct alignas( 64 ) taskRange
+        {
+            atomic<unsigned long long> span; /**< Packed range of tasks   */
+        };
+
+        vector<thread> workers;   /**< Threads besides the one calling run  */
+        mutex owner;              /**< Held by the thread handing out a job,
+                                       or changing the workers            */
+        mutex lock;               /**< Guards the job and the counts below  */
+        condition_variable wake;  /**< Wakes the workers for a new job      */
+        condition_variable done;  /**< Wakes run once the workers finish    */
+
+        const function<void( int )>* job; /**< Task of the current job      */
+        vector<taskRange> ranges; /**< Tasks left for each thread, the
+                                       calling thread's last              */
+        int busy;                 /**< Workers still on the current job     */
+        unsigned long generation; /**< Goes up by one for every job         */
+        bool stopping;            /**< True when the workers should quit    */
+};
+
+
+/**
+* @brief A file mapped read only into memory so it can be parsed in place.
+*/
+class mappedFile
+{
+    public:
+        mappedFile();
+        ~mappedFile();
+
+        bool open( string filename );
+        void close();
+        const pixel* getData() const;
+        size_t getSize() const;
+
+    private:
+        const pixel *data;  /**< First byte of the mapped file            */
+        size_t size;        /**< Number of bytes in the mapped file       */
+};
+
+
+/**
+* @brief Holds the data for .ppm and .pgm images. An image can also be a
+*        view of a rectangle of another image, sharing its pixels.
 */
 class netPBM
 {
     public:
         netPBM();
-        netPBM( netPBM &img );
+        netPBM( const netPBM &img );
+        netPBM( netPBM &&img );
         ~netPBM();
 
         /**
         * @brief Way to output image data
         */
-        enum outputType{ ASCII, /**< Output to ascii  */
-                         RAW    /**< Output to binary */
+        enum outputType{ ASCII,        /**< Output to ascii, a pixel per line */
+                         RAW,          /**< Output to binary                  */
+                         PACKED_ASCII  /**< Output to ascii, lines filled up
+                                            to ASCII_LINE_LENGTH            */
+                       };
+
+        /**
+        * @brief Way to compute gray values
+        */
+        enum grayMode{ GRAY_FIXED, /**< Fixed point, ( 3r + 6g + b ) / 10    */
+                       GRAY_EXACT  /**< Double precision, matches the output
+                                        of older versions bit for bit      */
+                     };
+
+        /**
+        * @brief Selects one of the color planes of an image
+        */
+        enum colorPlane{ RED_GRAY, /**< Red or gray plane */
+                         GREEN,    /**< Green plane       */
+                         BLUE      /**< Blue plane        */
                        };
 
+        int getRows() const;
+        int getCols() const;
+        int getStride() const;
+        const pixel* getRow( colorPlane plane, int row );
+        pixel* getEditableRow( colorPlane plane, int row );
+        netPBM view( int row, int col, int height, int width ) const;
+        void detach();
+
         bool readInImage(string filename);
         bool writeOutImage(string filename, outputType out);
         bool writeOutGrayImage( string filename, outputType out );
@@ -42,12 +331,17 @@ class netPBM
         void readAscii( ifstream& fin );
         void readBinary( ifstream& fin );
         void outputHeader( ofstream& fout, string magicNum );
+        void writeAscii( ofstream& fout, bool packed );
+        void writeBinary( ofstream& fout );
+        void writeGrayAscii( ofstream& fout, bool packed );
+        void writeGrayBinary( ofstream& fout );
 
         void sharpen();
         void smooth();
         void negate();
         void brighten( int value );
-        void grayscale();
+        void grayscale( grayMode mode = GRAY_FIXED );
+        void grayscaleContrast( grayMode mode = GRAY_FIXED );
         void contrast();
         void rotateCW();
         void rotateCCW();
@@ -57,31 +351,90 @@ class netPBM
         void removeGreen();
         void removeBlue();
         void icon(int row, int col, int height, int width);
-        void blur();
+        void blur( int radius = 3 );
+        void convolve( const convKernel& kernel );
+        void blurVertical( int radius = 3 );
 
-        void operator=( netPBM img2 );
-        bool operator==( netPBM img );
-        bool operator!=( netPBM img );
+        netPBM& operator=( const netPBM &img );
+        netPBM& operator=( netPBM &&img );
+        bool operator==( const netPBM &img ) const;
+        bool operator!=( const netPBM &img ) const;
 
     protected:
-        pixel cropRound( double value );
-        pixel** alloc2d( int rows, int cols );
-        void free2d( pixel**& ptr, int rows );
-        void findScale( double& scale, double& min );
+        void applyStencil( void ( *rowKernel )( const pixel*, const pixel*,
+            const pixel*, pixel*, int ) );
+        bool allocImage( int height, int width );
+        void freeImage();
+        size_t imageSize() const;
+        void makeUnique();
+        void copyPixels();
+        bool isView() const;
+        bool readMappedImage( string filename );
+        void parseAscii( const pixel* pos, const pixel* end );
+        size_t placeSamples( const pixel* pos, const pixel* end, size_t first );
+        bool parseHeader( const pixel*& pos, const pixel* end, string& magicNum,
+            int& width, int& height );
+        void stretchGray( pixel low, pixel high );
+        void findGrayRange( pixel& low, pixel& high ) const;
+        void applyLuts();
+        void applyTable( pixel* plane, const pixel* lut );
+        void clearLuts();
+        void writeTextRows( ofstream& fout, bool packed, bool gray );
 
     private:
         int rows;           /**< Amount of rows in the image                 */
         int cols;           /**< Amount of columns in the image              */
         string comments;    /**< Comments stored in the image file           */
 
-        pixel **redGray;    /**< 2d array that holds the red or gray pixels  */
-        pixel **green;      /**< 2d array that holds the green pixels        */
-        pixel **blue;       /**< 2d array that holds the blue pixels         */
+        int stride;         /**< Distance between the start of two rows,
+                                 a multiple of ROW_ALIGN                     */
+
+        pixelBlock *block;  /**< Shared block that holds all three planes    */
+        pixel *redGray;     /**< Plane that holds the red or gray pixels     */
+        pixel *green;       /**< Plane that holds the green pixels           */
+        pixel *blue;        /**< Plane that holds the blue pixels            */
+
+        pixel luts[3][256]; /**< Pointwise changes waiting to be applied to
+                                 each plane, see applyLuts                   */
+        bool lutPending;    /**< True if luts may not leave pixels alone     */
 };
 
 /*******************************************************************************
  *                         Function Prototypes
  ******************************************************************************/
 void outputErrorMessage();
+int cpuFeatures();
+void useCpuFeatures( int features );
+void addSaturate( pixel* data, int count, pixel amount );
+void subSaturate( pixel* data, int count, pixel amount );
+void invertPixels( pixel* data, int count );
+void fillPixels( pixel* data, int count, pixel value );
+void grayscaleFixed( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* gray, int count );
+void grayscaleExact( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* gray, int count );
+void findRange( const pixel* data, int count, pixel& low, pixel& high );
+void applyLut( pixel* data, int count, const pixel* lut );
+void reversePixels( pixel* data, int count );
+void sharpenRow( const pixel* above, const pixel* center, const pixel* below,
+    pixel* dest, int count );
+void smoothRow( const pixel* above, const pixel* center, const pixel* below,
+    pixel* dest, int count );
+void transposePlane( const pixel* src, ptrdiff_t srcStride, pixel* dest,
+    ptrdiff_t destStride, int height, int width );
+void deinterleaveRGB( const pixel* src, pixel* red, pixel* green, pixel* blue,
+    int count );
+size_t formatAsciiRow( const pixel* red, const pixel* green, const pixel* blue,
+    int count, bool packed, char* dest );
+int parseSamples( const pixel*& pos, const pixel* end, pixel* dest, int count );
+bool parseKernel( string text, convKernel& kernel );
+bool readKernel( string name, convKernel& kernel );
+void interleaveRGB( const pixel* red, const pixel* green, const pixel* blue,
+    pixel* dest, int count );
+int parallelBands( int count, int grain );
+void parallelRows( int count, int grain,
+    const function<void( int first, int last )>& band );
+void parallelTiles( int height, int width, int tileRows, int tileCols,
+    const function<void( int top, int left, int bottom, int right )>& tile );
 
 #endif
\ No newline at end of file
@@ -38,15 +38,28 @@
                   grayscale pixel.
     -c Contrast    - grayscales the image and subtracts the minimum value from 
                   each pixel and then multiplies it by the scale
+    -gx, -cx       - grayscale and contrast using the double precision gray
+                  values of older versions instead of fixed point.
     -CW Clockwise  - rotates the image clockwise
     -CCW CounterCW - rotates the image counterclockwise
     -x Flip x      - flips the image across the x-axis
     -y Flip y      - flips the image across the y-axis
     -i Icon        - creates an icon
     -r Remove      - sets the given color to 0 for each pixel.
-    -bl Blur       - applies a horizontal blur to the image.
+    -bl Blur       - averages each pixel with the radius pixels on either
+                  side of it, 3 if no radius is given.
+    -blv Blur      - averages each pixel with the radius pixels above and
+                  below it, 3 if no radius is given.
+    -k Kernel      - runs a convolution kernel over the image. The kernel is
+                  read from a file, or typed in place of the file name, as
+                  the height, the width, the weights row by row, and an
+                  optional divisor, for example "3,3,0,-1,0,-1,5,-1,0,-1,0".
    @endverbatim
   *
+  * Any of them can be started with -j and a number of threads. The image is
+  * split into bands of rows or into tiles that are worked on by that many
+  * threads at once, giving the same image as a single thread.
+  *
   * If grayscale or contrast is chosen, it will output a .pgm file.
   * 
   * @section compile_section Compiling and Usage
@@ -56,7 +69,10 @@
   *
   * @par Usage:
     @verbatim
-    c:\> thpf.exe [option] -o[ab] basename image.ppm
+    c:\> thpf.exe [-j #] [option] -o[abp] basename image.ppm
+              -j #          Threads to split the work between, one per
+                            processor if 0, 1 if not given, at most 4
+                            per processor
             Option          Option Name
               -n            Negate
               -b #          Brighten
@@ -64,11 +80,15 @@
               -s            Smooth
               -g            Grayscale
               -c            Contrast
+              -gx           Grayscale, exact
+              -cx           Contrast, exact
               -CW           Clockwise
               -CCW          Counterclockwise
               -x            Flip x
               -y            Flip y
-              -bl           Blur
+              -bl [#]       Blur, horizontal
+              -blv [#]      Blur, vertical
+              -k kernel     Convolve
               -i h w r c    Icon
                    h - Height of icon
                    w - Width of icon
@@ -77,6 +97,7 @@
               -r [r,g,b]    Remove
             -oa - Convert image to ascii format
             -ob - Convert image to binary format
+            -op - Convert image to ascii format with full lines
             basename  - output image name
             image.ppm - input image
     @endverbatim
@@ -111,7 +132,7 @@
  * 
  * @par Example
  * @verbatim
-   // thpf.exe [option] -o[ab] basename image.ppm
+   // thpf.exe [-j #] [option] -o[ab] basename image.ppm
    @endverbatim
  *****************************************************************************/
 int main( int argc, char** argv )
@@ -126,11 +147,30 @@ int main( int argc, char** argv )
     int row;
     int value;
     int width;
+    int threads = 1;
     ifstream fin;
     ofstream fout;
     netPBM img;
     netPBM img2;
+    netPBM::outputType out;
+    netPBM::grayMode gray;
+    convKernel kernel;
+
 
+    // Take the thread count off the front of the args.
+    if ( ( argc > 2 ) && ( strcmp( argv[1], "-j" ) == 0 ) )
+    {
+        threads = atoi( argv[2] );
+        if ( threads < 0 )
+        {
+            outputErrorMessage();
+            return 0;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    threadPool::global().setThreads( threads );
 
     //Check for valid number of command line args
     if ( ( argc < 4 ) || ( ( argc > 6 ) && ( argc < 9 ) ) || ( argc > 9 ) )
@@ -143,7 +183,7 @@ int main( int argc, char** argv )
     if ( argc == 4 )
     {
         if ( !( ( strcmp( argv[1], "-oa" ) == 0 ) ||
-            ( strcmp( argv[1], "-ob" ) == 0 ) ) )
+            ( strcmp( argv[1], "-ob" ) == 0 ) || ( strcmp( argv[1], "-op" ) == 0 ) ) )
         {
             outputErrorMessage();
             return 0;
@@ -162,8 +202,10 @@ int main( int argc, char** argv )
             || ( strcmp( argv[1], "-x" ) == 0 ) || ( strcmp( argv[1], "-y" ) == 0 ) 
             || ( strcmp( argv[1], "-==" ) == 0 ) || ( strcmp(argv[1], "-!=") == 0 ) 
             || ( strcmp( argv[1], "-CW" ) == 0 ) || ( strcmp(argv[1], "-CCW" )== 0 ) 
-            || ( strcmp( argv[1], "-bl" ) == 0 ) ) &&
-            !( ( strcmp( argv[2], "-oa" ) == 0 ) || ( strcmp( argv[2], "-ob" ) == 0 ) ) ) 
+            || ( strcmp( argv[1], "-bl" ) == 0 ) || ( strcmp( argv[1], "-gx" ) == 0 )
+            || ( strcmp( argv[1], "-cx" ) == 0 ) || ( strcmp( argv[1], "-blv" ) == 0 ) ) &&
+            !( ( strcmp( argv[2], "-oa" ) == 0 ) || ( strcmp( argv[2], "-ob" ) == 0 )
+            || ( strcmp( argv[2], "-op" ) == 0 ) ) ) 
         {
             outputErrorMessage();
             return 0;
@@ -177,22 +219,45 @@ int main( int argc, char** argv )
         format = argv[2];
         basename = argv[3];
         baseimage = argv[4];
+
+        // Blur uses a radius of 3 when none is given.
+        value = 3;
     }
 
     //Check if 6 args has valid options
     else if ( argc == 6 )
     {
         if ( !( ( strcmp( argv[3], "-oa" ) == 0 ) || ( strcmp( argv[3], "-ob" ) == 0 )
-            || ( ( strcmp( argv[1], "-b" ) != 0 )  && ( strcmp( argv[1], "-r" ) != 0 ) ) ) )
+            || ( strcmp( argv[3], "-op" ) == 0 ) )
+            || !( ( strcmp( argv[1], "-b" ) == 0 ) || ( strcmp( argv[1], "-r" ) == 0 )
+            || ( strcmp( argv[1], "-bl" ) == 0 ) || ( strcmp( argv[1], "-blv" ) == 0 )
+            || ( strcmp( argv[1], "-k" ) == 0 ) ) )
         {
             outputErrorMessage();
             return 0;
         }
         option = argv[1];
-        if (option == "-b")
+        if ( ( option == "-bl" ) || ( option == "-blv" ) )
+        {
+            value = atoi( argv[2] );
+            if ( value < 0 )
+            {
+                outputErrorMessage();
+                return 0;
+            }
+        }
+        else if (option == "-b")
         {
             value = atoi( argv[2] );
         }
+        else if ( option == "-k" )
+        {
+            if ( !readKernel( argv[2], kernel ) )
+            {
+                cout << "Could not read kernel " << argv[2];
+                return 0;
+            }
+        }
         else 
         {
             color = argv[2];
@@ -205,7 +270,8 @@ int main( int argc, char** argv )
     // Check 9 arguments
     else
     {
-        if ( !( ( strcmp( argv[6], "-oa" ) == 0 ) || ( strcmp( argv[6], "-ob" ) == 0 ) )
+        if ( !( ( strcmp( argv[6], "-oa" ) == 0 ) || ( strcmp( argv[6], "-ob" ) == 0 )
+            || ( strcmp( argv[6], "-op" ) == 0 ) )
             || ( strcmp( argv[1], "-i" ) != 0 ) )
         {
             outputErrorMessage();
@@ -222,6 +288,15 @@ int main( int argc, char** argv )
     }
 
 
+    // The x versions of grayscale and contrast use the exact gray values.
+    gray = netPBM::GRAY_FIXED;
+    if ( ( option == "-gx" ) || ( option == "-cx" ) )
+    {
+        gray = netPBM::GRAY_EXACT;
+        option.erase( 2 );
+    }
+
+
     // Add the file extension to the basename.
     if ( ( option == "-g" ) || ( option == "-c" ) )
     {
@@ -250,13 +325,13 @@ int main( int argc, char** argv )
     {
         img.negate();
     }
-    else if ( ( option == "-g" ) || (option == "-c") )
+    else if ( option == "-g" )
     {
-        img.grayscale();
-        if (option == "-c")
-        {
-            img.contrast();
-        }
+        img.grayscale( gray );
+    }
+    else if ( option == "-c" )
+    {
+        img.grayscaleContrast( gray );
     }
     else if ( option == "-p" )
     {
@@ -303,7 +378,15 @@ int main( int argc, char** argv )
     }
     else if ( option == "-bl" )
     {
-        img.blur();
+        img.blur( value );
+    }
+    else if ( option == "-blv" )
+    {
+        img.blurVertical( value );
+    }
+    else if ( option == "-k" )
+    {
+        img.convolve( kernel );
     }
 
     // Used to show off == operator.
@@ -342,15 +425,16 @@ int main( int argc, char** argv )
     
 
     // Write out images in ascii.
-    if (format == "-oa")
+    if ( ( format == "-oa" ) || ( format == "-op" ) )
     {
+        out = ( format == "-op" ) ? netPBM::PACKED_ASCII : netPBM::ASCII;
         if ( (option == "-g") || (option == "-c") )
         {
-            img.writeOutGrayImage( basename, netPBM::ASCII );
+            img.writeOutGrayImage( basename, out );
         }
         else
         {
-            if(!img.writeOutImage( basename, netPBM::ASCII ))
+            if(!img.writeOutImage( basename, out ))
             {
                 cout << "Could not open " << basename;
                 return 0;
@@ -393,7 +477,8 @@ int main( int argc, char** argv )
  *****************************************************************************/
 void outputErrorMessage()
 {
-    cout << "Usage: thpf.exe [option] -o[ab] basename image.ppm" << endl <<
+    cout << "Usage: thpf.exe [-j #] [option] -o[abp] basename image.ppm" << endl <<
+        " -j #          Threads, one per processor if 0, 1 if not given" << endl <<
         "Option" << endl <<
         " -n            Negate" << endl <<
         " -b #          Brighten" << endl <<
@@ -401,11 +486,17 @@ void outputErrorMessage()
         " -s            Smooth" << endl <<
         " -g            Grayscale" << endl <<
         " -c            Contrast" << endl <<
+        " -gx           Grayscale, exact" << endl <<
+        " -cx           Contrast, exact" << endl <<
         " -CW           Clockwise" << endl <<
         " -CCW          Counterclockwise" << endl <<
         " -x            Flip x" << endl <<
         " -y            Flip y" << endl <<
-        " -bl           Blur" << endl <<
+        " -bl [#]       Blur, horizontal" << endl <<
+        " -blv [#]      Blur, vertical" << endl <<
+        "      # - radius, 3 if not given" << endl <<
+        " -k kernel     Convolve" << endl <<
+        "      kernel - kernel file, or \"h,w,weights,divisor\"" << endl <<
         " -r [r,g,b]    Remove" << endl <<
         "      [r,g,b] - red, green, blue" << endl <<
         " -i h w r c    Icon" << endl <<
@@ -415,6 +506,7 @@ void outputErrorMessage()
         "      c - starting column" << endl <<
         "-oa - Convert image to ascii format" << endl <<
         "-ob - Convert image to binary format" << endl <<
+        "-op - Convert image to ascii format with full lines" << endl <<
         "basename  - output image name" << endl <<
         "image.ppm - input image" << endl;
 }
\ No newline at end of file
@@ -0,0 +1,533 @@
+/** **************************************************************************
+ * @file
+ *
+ * @brief Holds the functions for the threadPool that splits the rows of an
+ *        image operation between several threads.
+ ****************************************************************************/
+#include "netPBM.h"
+#include <system_error>
+
+/**
+ * @brief True on a thread while it is working on a task of the pool, so a
+ *        task that runs another parallel loop does it on its own thread
+ *        instead of waiting on workers that are all busy.
+ */
+static thread_local bool insidePool = false;
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Packs a range of tasks into the single number a taskRange holds, so both
+ * ends can be changed at once with a compare and swap.
+ *
+ * @param[in]     first - first task of the range.
+ * @param[in]     end - task just past the end of the range.
+ *
+ * @returns first in the high 32 bits and end in the low 32 bits.
+ *
+ * @par Example
+ * @verbatim
+   // ranges[k].span = packRange( first, end );
+   @endverbatim
+ *****************************************************************************/
+static unsigned long long packRange( unsigned int first, unsigned int end )
+{
+    return ( ( unsigned long long ) first << 32 ) | end;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Constructor for the threadPool class. Starts with no workers, so every
+ * task runs on the calling thread until setThreads is called.
+ *
+ * @par Example
+ * @verbatim
+   // threadPool pool;
+   @endverbatim
+ *****************************************************************************/
+threadPool::threadPool()
+{
+    job = nullptr;
+    busy = 0;
+    generation = 0;
+    stopping = false;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * The deconstructor for the threadPool class. Tells the workers to stop and
+ * waits for them to finish.
+ *
+ * @par Example
+ * @verbatim
+   // Don't call the deconstructor, does it automatically.
+   @endverbatim
+ *****************************************************************************/
+threadPool::~threadPool()
+{
+    stopWorkers();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the number of threads that work on each parallel loop, counting the
+ * thread that starts it.
+ *
+ * @returns the number of threads.
+ *
+ * @par Example
+ * @verbatim
+   // threads = threadPool::global().getThreads();
+   @endverbatim
+ *****************************************************************************/
+int threadPool::getThreads() const
+{
+    return ( int ) workers.size() + 1;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Gets the pool every netPBM operation splits its rows between. It starts
+ * out with a single thread.
+ *
+ * @returns the shared pool.
+ *
+ * @par Example
+ * @verbatim
+   // threadPool::global().setThreads( 4 );
+   @endverbatim
+ *****************************************************************************/
+threadPool& threadPool::global()
+{
+    static threadPool pool;
+
+    return pool;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Runs task once for each number from 0 up to tasks. Each thread, the
+ * workers and the calling thread, starts with an even share of the numbers
+ * in a row and runs them in order, so neighboring tiles stay on the same
+ * thread. A thread that runs out steals the back half of what another
+ * thread has left, see takeTask, so the threads keep busy even when some
+ * tasks cost far more than others. This only returns once every task has
+ * finished. With one thread, from inside another task, or while another
+ * thread has a job in the pool, the tasks are just run in order here, so
+ * threads sharing the pool never wait on each other's jobs.
+ *
+ * @param[in]     tasks - number of tasks.
+ * @param[in]     task - called with the number of each task.
+ *
+ * @par Example
+ * @verbatim
+   // pool.run( bands, work );
+   @endverbatim
+ *****************************************************************************/
+void threadPool::run( int tasks, const function<void( int )>& task )
+{
+    int i;
+    int k;
+    int self;
+    int count;
+    unique_lock<mutex> running( owner, defer_lock );
+
+    // Not worth waking anyone up, or the workers are busy with another job.
+    if ( ( tasks <= 1 ) || insidePool || !running.try_lock() ||
+        workers.empty() )
+    {
+        for ( i = 0; i < tasks; i++ )
+        {
+            task( i );
+        }
+        return;
+    }
+
+    // Split the tasks evenly, hand out the job, and wake the workers.
+    count = ( int ) ranges.size();
+    self = count - 1;
+    {
+        unique_lock<mutex> guard( lock );
+        job = &task;
+        for ( k = 0; k < count; k++ )
+        {
+            ranges[k].span = packRange(
+                ( unsigned int ) ( ( long long ) tasks * k / count ),
+                ( unsigned int ) ( ( long long ) tasks * ( k + 1 ) / count ) );
+        }
+        busy = ( int ) workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    // Take tasks along with the workers.
+    insidePool = true;
+    while ( ( i = takeTask( self ) ) >= 0 )
+    {
+        task( i );
+    }
+    insidePool = false;
+
+    // Wait for the tasks the workers took.
+    unique_lock<mutex> guard( lock );
+    done.wait( guard, [this] { return busy == 0; } );
+    job = nullptr;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Sets the number of threads that work on each parallel loop, counting the
+ * thread that starts it. The workers are started here and then wait for
+ * work, so they are not started again for every operation. A count of 0 or
+ * less uses one thread per processor, and the count is cut down to
+ * THREADS_PER_PROCESSOR threads a processor. If the system will not start
+ * any more threads, the pool keeps the ones it has. It waits for a job
+ * another thread is running to finish first.
+ *
+ * @param[in]     count - number of threads.
+ *
+ * @par Example
+ * @verbatim
+   // threadPool::global().setThreads( 8 );
+   @endverbatim
+ *****************************************************************************/
+void threadPool::setThreads( int count )
+{
+    int i;
+    int processors = ( int ) thread::hardware_concurrency();
+
+    if ( processors <= 0 )
+    {
+        processors = 1;
+    }
+    if ( count <= 0 )
+    {
+        count = processors;
+    }
+    if ( count > THREADS_PER_PROCESSOR * processors )
+    {
+        count = THREADS_PER_PROCESSOR * processors;
+    }
+
+    lock_guard<mutex> running( owner );
+    stopWorkers();
+    stopping = false;
+    ranges = vector<taskRange>( count );
+    for ( i = 1; i < count; i++ )
+    {
+        try
+        {
+            workers.emplace_back( &threadPool::workerLoop, this, i - 1,
+                generation );
+        }
+        catch ( const system_error& )
+        {
+            // The workers are all waiting, give each one a range.
+            ranges = vector<taskRange>( workers.size() + 1 );
+            break;
+        }
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Tells every worker to stop and waits for them to finish.
+ *
+ * @par Example
+ * @verbatim
+   // stopWorkers();
+   @endverbatim
+ *****************************************************************************/
+void threadPool::stopWorkers()
+{
+    size_t i;
+
+    {
+        unique_lock<mutex> guard( lock );
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for ( i = 0; i < workers.size(); i++ )
+    {
+        workers[i].join();
+    }
+    workers.clear();
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Takes the next task for a thread. It comes off the front of the thread's
+ * own range if there is anything left in it. Otherwise the other ranges are
+ * gone through and the back half of the first one with anything left is
+ * stolen, the first stolen task is returned and the rest become the thread's
+ * own range. Ranges are only changed by compare and swap, so the owner
+ * taking from the front and a thief taking from the back never hand out the
+ * same task twice.
+ *
+ * @param[in]     self - index of the calling thread's range.
+ *
+ * @returns the task to run, or -1 if every range is empty.
+ *
+ * @par Example
+ * @verbatim
+   // while ( ( i = takeTask( self ) ) >= 0 )
+   @endverbatim
+ *****************************************************************************/
+int threadPool::takeTask( int self )
+{
+    int k;
+    int count;
+    unsigned int first;
+    unsigned int end;
+    unsigned int middle;
+    unsigned long long span;
+
+    // Take the next task of this thread's own range.
+    span = ranges[self].span;
+    while ( ( first = ( unsigned int ) ( span >> 32 ) ) <
+        ( end = ( unsigned int ) span ) )
+    {
+        if ( ranges[self].span.compare_exchange_weak( span,
+            packRange( first + 1, end ) ) )
+        {
+            return ( int ) first;
+        }
+    }
+
+    // Out of tasks, steal the back half of another thread's range.
+    count = ( int ) ranges.size();
+    for ( k = 1; k < count; k++ )
+    {
+        taskRange& victim = ranges[( self + k ) % count];
+        span = victim.span;
+        while ( ( first = ( unsigned int ) ( span >> 32 ) ) <
+            ( end = ( unsigned int ) span ) )
+        {
+            middle = first + ( end - first ) / 2;
+            if ( victim.span.compare_exchange_weak( span,
+                packRange( first, middle ) ) )
+            {
+                ranges[self].span = packRange( middle + 1, end );
+                return ( int ) middle;
+            }
+        }
+    }
+
+    return -1;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * What each worker thread runs. It sleeps until a new job is handed out,
+ * takes tasks from it until there are none left, and lets run know when it
+ * is done, over and over until the pool is stopped.
+ *
+ * @param[in]     self - index of the worker's range.
+ * @param[in]     seen - the last job handed out before the worker started.
+ *
+ * @par Example
+ * @verbatim
+   // workers.emplace_back( &threadPool::workerLoop, this, 0, generation );
+   @endverbatim
+ *****************************************************************************/
+void threadPool::workerLoop( int self, unsigned long seen )
+{
+    int i;
+    const function<void( int )>* task;
+
+    insidePool = true;
+    while ( true )
+    {
+        // Sleep until there is a new job or the pool stops.
+        {
+            unique_lock<mutex> guard( lock );
+            wake.wait( guard, [&] { return stopping || ( generation != seen ); } );
+            if ( stopping )
+            {
+                return;
+            }
+            seen = generation;
+            task = job;
+        }
+
+        while ( ( i = takeTask( self ) ) >= 0 )
+        {
+            ( *task )( i );
+        }
+
+        // Let run know this worker is finished with the job.
+        {
+            unique_lock<mutex> guard( lock );
+            if ( --busy == 0 )
+            {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Works out how many bands parallelRows splits count rows into, one for each
+ * thread of the global pool but keeping at least grain rows in a band, so
+ * small images are not split up more than is worth it. Band b runs from row
+ * count * b / bands up to row count * ( b + 1 ) / bands.
+ *
+ * @param[in]     count - number of rows to split up.
+ * @param[in]     grain - fewest rows worth giving a band.
+ *
+ * @returns the number of bands, 0 if there are no rows.
+ *
+ * @par Example
+ * @verbatim
+   // bands = parallelBands( rows, BAND_ROWS );
+   @endverbatim
+ *****************************************************************************/
+int parallelBands( int count, int grain )
+{
+    int bands;
+
+    if ( count <= 0 )
+    {
+        return 0;
+    }
+    if ( grain < 1 )
+    {
+        grain = 1;
+    }
+
+    bands = ( count + grain - 1 ) / grain;
+    if ( bands > threadPool::global().getThreads() )
+    {
+        bands = threadPool::global().getThreads();
+    }
+
+    return bands;
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Splits the numbers from 0 up to count into bands, see parallelBands, and
+ * works on the bands at the same time on the threads of the global pool.
+ * The netPBM operations call this with the rows of an image, or with tiles
+ * when those split up better.
+ *
+ * @param[in]     count - number of rows to split up.
+ * @param[in]     grain - fewest rows worth giving a band.
+ * @param[in]     band - called with the first row of a band and the row
+ *                       just past its end.
+ *
+ * @par Example
+ * @verbatim
+   // parallelRows( rows, BAND_ROWS, work );
+   @endverbatim
+ *****************************************************************************/
+void parallelRows( int count, int grain,
+    const function<void( int first, int last )>& band )
+{
+    int bands;
+
+    bands = parallelBands( count, grain );
+    threadPool::global().run( bands, [&]( int b )
+        {
+            band( ( int ) ( ( long long ) count * b / bands ),
+                ( int ) ( ( long long ) count * ( b + 1 ) / bands ) );
+        } );
+}
+
+
+
+/** ***************************************************************************
+ * @author Aidan Justice
+ *
+ * @par Description
+ * Splits a height by width area into tiles and works on them at the same
+ * time on the threads of the global pool. The tiles are numbered across
+ * and then down, so each thread starts on a run of neighboring tiles, and
+ * threads that finish early steal tiles from the others, see
+ * threadPool::run. The tiles along the bottom and right edges are cut down
+ * to fit. Tiles that need pixels outside their edges read those halo
+ * pixels from the source themselves.
+ *
+ * @param[in]     height - number of rows to split up.
+ * @param[in]     width - number of columns to split up.
+ * @param[in]     tileRows - most rows in a tile.
+ * @param[in]     tileCols - most columns in a tile.
+ * @param[in]     tile - called with the first row and column of a tile and
+ *                       the row and column just past its end.
+ *
+ * @par Example
+ * @verbatim
+   // parallelTiles( rows, cols, TILE_ROWS, TILE_COLS, work );
+   @endverbatim
+ *****************************************************************************/
+void parallelTiles( int height, int width, int tileRows, int tileCols,
+    const function<void( int top, int left, int bottom, int right )>& tile )
+{
+    int down;
+    int across;
+
+    if ( ( height <= 0 ) || ( width <= 0 ) )
+    {
+        return;
+    }
+
+    down = ( height + tileRows - 1 ) / tileRows;
+    across = ( width + tileCols - 1 ) / tileCols;
+    threadPool::global().run( down * across, [&]( int t )
+        {
+            int top = ( t / across ) * tileRows;
+            int left = ( t % across ) * tileCols;
+
+            tile( top, left, min( top + tileRows, height ),
+                min( left + tileCols, width ) );
+        } );
+}